@@ -0,0 +1,275 @@
+/**
+ * Encode and decode throughput of proto::dht::Message for every wire
+ * format, one CSV row per codec, message shape and direction:
+ *
+ *   codec,case,entries,op,bytes,iterations,ns_per_op,ops_per_sec,allocs_per_op
+ *
+ * Rows of a codec that cannot carry a message are left out. Messages are
+ * encoded into a buffer reused across iterations and decoded over a reused
+ * message, as MessageQueue does.
+ *
+ *   ./SerializationBench [--min-time-ms N] [--max-entries N] > bench.csv
+ */
+
+#include "net/FlatMessage.h"
+#include "net/Message.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace proto::dht;
+
+// Every allocation of the process is counted, the benchmark is single
+// threaded
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    if (auto *ptr = malloc(size ? size : 1))
+        return ptr;
+    throw bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+// Defeats dead code elimination of the measured work
+static volatile size_t sink;
+
+struct BenchCase {
+    string  name;
+    Message msg;
+    size_t  entries;
+};
+
+struct Result {
+    size_t  iterations;
+    double  nsPerOp;
+    double  allocsPerOp;
+};
+
+/**
+ * Codec under test, encode() leaves the message in encoded, decode()
+ * reads it back from there
+ */
+class Codec {
+public:
+    virtual ~Codec() = default;
+    virtual const char* name() = 0;
+    // False when the codec cannot carry the message
+    virtual bool prepare(const Message &msg) = 0;
+    virtual void encode(const Message &msg) = 0;
+    virtual void decode(Message &msg) = 0;
+
+    vector<char> encoded;
+    size_t       encodedSize = 0;
+};
+
+/**
+ * Thrift protocol writing through PayloadWriter into a fixed buffer and
+ * reading from TMemoryBuffer, the MessageQueue path
+ */
+template <typename Protocol>
+class ThriftCodec : public Codec {
+public:
+    explicit ThriftCodec(const char *codecName)
+        : codecName(codecName),
+          writer(boost::make_shared<PayloadWriter>()),
+          reader(boost::make_shared<TMemoryBuffer>(nullptr, 0)),
+          outputProtocol(boost::make_shared<Protocol>(writer)),
+          inputProtocol(boost::make_shared<Protocol>(reader)) {}
+
+    const char* name() override {
+        return codecName;
+    }
+
+    // Size is taken from an encode into a growing buffer
+    bool prepare(const Message &msg) override {
+        auto sizing = boost::make_shared<TMemoryBuffer>();
+        auto protocol = Protocol(sizing);
+        msg.write(&protocol);
+        encoded.resize(sizing->available_read());
+        return true;
+    }
+
+    void encode(const Message &msg) override {
+        writer->reset(encoded.data(), encoded.size());
+        msg.write(outputProtocol.get());
+        encodedSize = writer->written();
+    }
+
+    void decode(Message &msg) override {
+        reader->resetBuffer((uint8_t *)encoded.data(), encodedSize);
+        msg.read(inputProtocol.get());
+    }
+
+private:
+    const char                      *codecName;
+    boost::shared_ptr<PayloadWriter> writer;
+    boost::shared_ptr<TMemoryBuffer> reader;
+    boost::shared_ptr<Protocol>      outputProtocol;
+    boost::shared_ptr<Protocol>      inputProtocol;
+};
+
+class FlatCodec : public Codec {
+public:
+    const char* name() override {
+        return "flat";
+    }
+
+    bool prepare(const Message &msg) override {
+        auto size = flatSize(msg);
+        if (size == SIZE_MAX)
+            return false;
+        encoded.resize(size);
+        return true;
+    }
+
+    void encode(const Message &msg) override {
+        encodedSize = flatSize(msg);
+        encodeFlat(msg, encoded.data());
+    }
+
+    void decode(Message &msg) override {
+        auto view = MessageView();
+        if (!viewFlat(encoded.data(), encodedSize, view)
+                || !materialize(view, msg)) {
+            throw TProtocolException(TProtocolException::INVALID_DATA);
+        }
+    }
+};
+
+static Message makeMessage(ReqType::type type) {
+    auto msg = Message();
+    msg.header.type = type;
+    msg.header.status = ReqStatus::OK;
+    msg.header.seqId = 7;
+    msg.header.transaction = 1234;
+    msg.header.srcAddr.bytes = encodeAsIp6(0x0100000a);
+    msg.header.srcPort = 0;
+    return msg;
+}
+
+// Keys and values shaped like the ones Application inserts
+static vector<BenchCase> makeCases(size_t maxEntries) {
+    auto cases = vector<BenchCase>();
+
+    cases.push_back(BenchCase{ "header", makeMessage(ReqType::DELETE_RSP), 0 });
+
+    auto create = makeMessage(ReqType::CREATE);
+    create.body.key = "key_0000000042";
+    create.body.value = string(64, 'v');
+    cases.push_back(BenchCase{ "create", create, 0 });
+
+    auto readRsp = makeMessage(ReqType::READ_RSP);
+    readRsp.body.key = "key_0000000042";
+    readRsp.body.value = string(64, 'v');
+    cases.push_back(BenchCase{ "read_rsp", readRsp, 0 });
+
+    for (auto entries = size_t(10); entries <= maxEntries; entries *= 10) {
+        auto sync = makeMessage(ReqType::SYNC_BEGIN);
+        char key[32];
+        for (size_t i = 0; i < entries; ++i) {
+            snprintf(key, sizeof(key), "key_%010zu", i);
+            sync.body.keyValueMap.emplace(key, string(64, 'v'));
+        }
+        cases.push_back(BenchCase{ "sync", move(sync), entries });
+    }
+    return cases;
+}
+
+/**
+ * Runs op in rounds of growing length until a round takes minTime, the
+ * last round is reported
+ */
+template <typename Op>
+static Result measure(Op op, chrono::nanoseconds minTime) {
+    using Clock = chrono::steady_clock;
+    op();   // warms up buffers and the reused message
+
+    auto iterations = size_t(1);
+    while (true) {
+        auto allocationsBefore = allocations;
+        auto start = Clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+            op();
+        auto elapsed = Clock::now() - start;
+        auto roundAllocations = allocations - allocationsBefore;
+
+        if (elapsed >= minTime || iterations >= (size_t(1) << 30)) {
+            auto ns = chrono::duration<double, nano>(elapsed).count();
+            return Result{ iterations, ns / iterations,
+                           double(roundAllocations) / iterations };
+        }
+        iterations *= 2;
+    }
+}
+
+static void report(Codec &codec, const BenchCase &benchCase, const char *op,
+                   const Result &result) {
+    printf("%s,%s,%zu,%s,%zu,%zu,%.1f,%.0f,%.2f\n",
+           codec.name(), benchCase.name.c_str(), benchCase.entries, op,
+           codec.encodedSize, result.iterations, result.nsPerOp,
+           1e9 / result.nsPerOp, result.allocsPerOp);
+    fflush(stdout);
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s [--min-time-ms N] [--max-entries N]\n",
+            program);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    auto minTimeMs = 200l;
+    auto maxEntries = size_t(100000);
+    for (auto i = 1; i < argc; ++i) {
+        if (i + 1 < argc && strcmp(argv[i], "--min-time-ms") == 0)
+            minTimeMs = atol(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--max-entries") == 0)
+            maxEntries = strtoul(argv[++i], nullptr, 10);
+        else
+            usage(argv[0]);
+    }
+    auto minTime = chrono::milliseconds(minTimeMs);
+
+    auto binary = ThriftCodec<TBinaryProtocol>("thrift_binary");
+    auto compact = ThriftCodec<TCompactProtocol>("thrift_compact");
+    auto flat = FlatCodec();
+    Codec *codecs[] = { &binary, &compact, &flat };
+
+    printf("codec,case,entries,op,bytes,iterations,ns_per_op,ops_per_sec,"
+           "allocs_per_op\n");
+    for (auto &benchCase : makeCases(maxEntries)) {
+        for (auto *codec : codecs) {
+            if (!codec->prepare(benchCase.msg))
+                continue;
+
+            auto &msg = benchCase.msg;
+            auto encodeResult = measure([&]() {
+                codec->encode(msg);
+                sink = codec->encodedSize;
+            }, minTime);
+            report(*codec, benchCase, "encode", encodeResult);
+
+            auto decoded = Message();
+            auto decodeResult = measure([&]() {
+                codec->decode(decoded);
+                sink = decoded.body.keyValueMap.size();
+            }, minTime);
+            report(*codec, benchCase, "decode", decodeResult);
+        }
+    }
+    return 0;
+}
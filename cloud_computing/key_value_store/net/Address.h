@@ -3,6 +3,7 @@
 
 #include <string>
 #include <cstring>
+#include <functional>
 #include <arpa/inet.h>
 
 class Address {
@@ -49,4 +50,14 @@ public:
 	}
 };
 
+namespace std {
+template<>
+struct hash<Address> {
+	size_t operator()(const Address &address) const {
+		uint64_t key = ((uint64_t)address.getIp() << 16) | address.getPort();
+		return hash<uint64_t>()(key);
+	}
+};
+}
+
 #endif
@@ -0,0 +1,167 @@
+#include "CoalescingTransport.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace net {
+
+using FrameLength = uint16_t;
+
+CoalescingTransport::CoalescingTransport(std::shared_ptr<Transport> inner,
+                                         size_t threshold)
+        : Transport(inner->getAddress(), DEFAULT_SEND_WINDOW) {
+    this->inner = move(inner);
+    this->threshold = std::min(threshold, this->inner->getMaxPayload());
+}
+
+bool CoalescingTransport::drain() {
+    auto result = inner->drain();
+    stats.syscalls = inner->getStats().syscalls;
+    return result;
+}
+
+/**
+ * Sealed envelopes go out first once their links have credits again
+ */
+void CoalescingTransport::notifyWritable() {
+    inner->notifyWritable();
+    for (auto &remote : openLinks) {
+        auto &envelope = envelopes[remote];
+        if (envelope.sealed)
+            flushLink(remote, envelope);
+    }
+    Transport::notifyWritable();
+}
+
+bool CoalescingTransport::pollnb() {
+    return !unpacked.empty() || inner->pollnb();
+}
+
+/**
+ * Returns len when the message joined the envelope of its link, -EAGAIN
+ * when the envelope is sealed, -EMSGSIZE when the message would not fit
+ * an envelope on its own.
+ */
+int CoalescingTransport::send(Address remote, char *data, size_t len) {
+    auto frameSize = sizeof(FrameLength) + len;
+    if (frameSize > inner->getMaxPayload()) {
+        stats.tooLarge++;
+        return -EMSGSIZE;
+    }
+
+    auto &envelope = envelopes[remote];
+    if (envelope.sealed && flushLink(remote, envelope) == -EAGAIN)
+        return -EAGAIN;
+    if (!envelope.buffer.empty()
+            && envelope.used + frameSize > envelope.buffer.size()
+            && flushLink(remote, envelope) == -EAGAIN)
+        return -EAGAIN;
+
+    if (envelope.buffer.empty()) {
+        envelope.buffer = inner->reserve(std::max(threshold, frameSize));
+        envelope.used = 0;
+        if (!envelope.listed) {
+            envelope.listed = true;
+            openLinks.push_back(remote);
+        }
+    }
+
+    auto frameLength = FrameLength(len);
+    auto *frame = envelope.buffer.data() + envelope.used;
+    memcpy(frame, &frameLength, sizeof(frameLength));
+    memcpy(frame + sizeof(frameLength), data, len);
+    envelope.used += frameSize;
+    stats.sent++;
+    return len;
+}
+
+/**
+ * Commits the envelope of the link, a refused one is sealed and kept
+ */
+int CoalescingTransport::flushLink(const Address &remote, Envelope &envelope) {
+    if (envelope.buffer.empty())
+        return 0;
+
+    envelope.buffer.truncate(envelope.used);
+    auto result = inner->commit(remote, move(envelope.buffer));
+    if (result == -EAGAIN) {
+        envelope.sealed = true;
+        markBlocked(remote);
+        return result;
+    }
+    envelope.buffer.reset();
+    envelope.used = 0;
+    envelope.sealed = false;
+    return result;
+}
+
+void CoalescingTransport::flush() {
+    auto isFlushed = [this](const Address &remote) {
+        auto &envelope = envelopes[remote];
+        if (flushLink(remote, envelope) == -EAGAIN)
+            return false;
+        envelope.listed = false;
+        return true;
+    };
+    openLinks.erase(remove_if(openLinks.begin(), openLinks.end(), isFlushed),
+                    openLinks.end());
+
+    inner->flush();
+    stats.syscalls = inner->getStats().syscalls;
+}
+
+/**
+ * A sealed envelope holds the link until the wrapped one takes it, an open
+ * one always has room for one more message.
+ */
+int CoalescingTransport::getCredits(const Address &remote) {
+    auto envelope = envelopes.find(remote);
+    if (envelope != envelopes.end() && envelope->second.sealed)
+        return 0;
+    return inner->getCredits(remote);
+}
+
+/**
+ * Splits the envelope into messages sharing its buffer, a torn frame and
+ * whatever follows it is dropped.
+ */
+void CoalescingTransport::unpack(IOBuf &&envelope) {
+    auto *frame = (char *)envelope.data;
+    auto *end = frame + envelope.size;
+
+    while (size_t(end - frame) >= sizeof(FrameLength)) {
+        FrameLength frameLength;
+        memcpy(&frameLength, frame, sizeof(frameLength));
+        auto *payload = frame + sizeof(frameLength);
+        if (frameLength > size_t(end - payload))
+            break;
+
+        frame = payload + frameLength;
+        // Last message takes the envelope handle itself
+        auto owner = frame == end ? move(envelope.owner)
+                                  : envelope.owner.share();
+        unpacked.push_back(IOBuf { payload, frameLength, move(owner) });
+    }
+}
+
+IOBuf CoalescingTransport::recieve() {
+    while (unpacked.empty() && inner->pollnb())
+        unpack(inner->recieve());
+    if (unpacked.empty())
+        return IOBuf();
+
+    auto buf = move(unpacked.front());
+    unpacked.pop_front();
+    return buf;
+}
+
+bool CoalescingTransport::wait(int timeoutMs) {
+    return !unpacked.empty() || inner->wait(timeoutMs);
+}
+
+size_t CoalescingTransport::getMaxPayload() {
+    return inner->getMaxPayload() - sizeof(FrameLength);
+}
+
+} // namespace net
@@ -0,0 +1,63 @@
+#ifndef COALESCINGTRANSPORT_H_
+#define COALESCINGTRANSPORT_H_
+
+#include "net/Transport.h"
+#include "simulator/BufferPool.h"
+
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace net {
+
+/**
+ * Packs messages sent to the same destination into envelopes of the
+ * wrapped transport, each message framed by its 16 bit length. An envelope
+ * goes out on flush() or once the next message would overflow the size
+ * threshold, so a link usually takes a single envelope per tick. Received
+ * envelopes are split back into messages sharing the envelope buffer.
+ * Both ends of a link have to coalesce.
+ *
+ * An envelope takes one credit of the wrapped link. When the link has none
+ * the envelope is sealed, it takes no more messages and send() returns
+ * -EAGAIN until it leaves.
+ */
+class CoalescingTransport : public Transport {
+public:
+    CoalescingTransport(std::shared_ptr<Transport> inner, size_t threshold);
+    CoalescingTransport(const CoalescingTransport&)            = delete;
+    CoalescingTransport& operator=(const CoalescingTransport&) = delete;
+
+    bool    drain() override;
+    bool    pollnb() override;
+    int     send(Address remote, char *data, size_t len) override;
+    int     getCredits(const Address &remote) override;
+    IOBuf   recieve() override;
+    void    flush() override;
+    bool    wait(int timeoutMs) override;
+    size_t  getMaxPayload() override;
+    void    notifyWritable() override;
+
+private:
+    struct Envelope {
+        PooledBuffer    buffer;
+        size_t          used   = 0;
+        bool            sealed = false;
+        bool            listed = false;     // in openLinks
+    };
+
+    int     flushLink(const Address &remote, Envelope &envelope);
+    void    unpack(IOBuf &&envelope);
+
+    std::shared_ptr<Transport>              inner;
+    size_t                                  threshold;
+    std::unordered_map<Address, Envelope>   envelopes;
+    // Links with an envelope to flush, in the order they were opened
+    std::vector<Address>                    openLinks;
+    std::deque<IOBuf>                       unpacked;
+};
+
+} // namespace net
+
+#endif
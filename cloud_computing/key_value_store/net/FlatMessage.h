@@ -0,0 +1,208 @@
+#ifndef FLATMESSAGE_H_
+#define FLATMESSAGE_H_
+
+#include "protocol/dht_proto_types.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+
+namespace proto {
+namespace dht {
+
+// Formats MessageQueue speaks, every node of a cluster has to use the same
+enum class WireFormat { THRIFT_COMPACT, FLAT };
+
+static const uint8_t FLAT_MAGIC = 0xD6;
+
+/**
+ * Fixed part of a flat message. Key and value bytes follow it, then the
+ * keyValueMap entries, each a 16 bit length and key bytes followed by a
+ * 16 bit length and value bytes. No transport takes a payload that needs
+ * longer lengths. Integers are in host byte order, like everywhere else
+ * in the simulator.
+ */
+struct FlatHeader {
+    uint8_t     magic;
+    uint8_t     type;
+    uint8_t     status;
+    uint8_t     reserved;
+    int32_t     seqId;
+    int32_t     transaction;
+    uint32_t    srcIp;
+    int16_t     srcPort;
+    uint16_t    keySize;
+    uint16_t    valueSize;
+    uint16_t    entriesCount;
+};
+
+static_assert(sizeof(FlatHeader) == 24, "flat header has no padding");
+
+using FlatLength = uint16_t;
+static const size_t FLAT_MAX_LENGTH = UINT16_MAX;
+
+/**
+ * Bytes inside a received buffer, valid as long as the buffer is
+ */
+struct BytesView {
+    const char  *data;
+    size_t      size;
+};
+
+/**
+ * Flat message decoded in place, nothing is copied out of the buffer
+ */
+struct MessageView {
+    FlatHeader  header;
+    BytesView   key;
+    BytesView   value;
+    BytesView   entries;
+};
+
+// SIZE_MAX when some length does not fit its field
+inline size_t flatSize(const Message &msg) {
+    auto &body = msg.body;
+    if (body.key.size() > FLAT_MAX_LENGTH
+            || body.value.size() > FLAT_MAX_LENGTH
+            || body.keyValueMap.size() > FLAT_MAX_LENGTH) {
+        return SIZE_MAX;
+    }
+    auto size = sizeof(FlatHeader) + body.key.size() + body.value.size();
+    for (auto &entry : body.keyValueMap) {
+        if (entry.first.size() > FLAT_MAX_LENGTH
+                || entry.second.size() > FLAT_MAX_LENGTH) {
+            return SIZE_MAX;
+        }
+        size += 2 * sizeof(FlatLength) + entry.first.size()
+              + entry.second.size();
+    }
+    return size;
+}
+
+inline char* putFlatBytes(char *pos, const std::string &bytes) {
+    auto size = FlatLength(bytes.size());
+    memcpy(pos, &size, sizeof(size));
+    memcpy(pos + sizeof(size), bytes.data(), size);
+    return pos + sizeof(size) + size;
+}
+
+/**
+ * Writes msg to out, which has to take flatSize(msg) bytes
+ */
+inline void encodeFlat(const Message &msg, char *out) {
+    auto header = FlatHeader();
+    header.magic = FLAT_MAGIC;
+    header.type = uint8_t(msg.header.type);
+    header.status = uint8_t(msg.header.status);
+    header.seqId = msg.header.seqId;
+    header.transaction = msg.header.transaction;
+    // IPv4 sits in the last bytes of the IPv4 mapped IPv6 address
+    assert(msg.header.srcAddr.bytes.size() == 16);
+    memcpy(&header.srcIp, msg.header.srcAddr.bytes.data() + 12,
+           sizeof(header.srcIp));
+    header.srcPort = msg.header.srcPort;
+    header.keySize = FlatLength(msg.body.key.size());
+    header.valueSize = FlatLength(msg.body.value.size());
+    header.entriesCount = FlatLength(msg.body.keyValueMap.size());
+
+    memcpy(out, &header, sizeof(header));
+    auto *pos = out + sizeof(header);
+    memcpy(pos, msg.body.key.data(), header.keySize);
+    pos += header.keySize;
+    memcpy(pos, msg.body.value.data(), header.valueSize);
+    pos += header.valueSize;
+    for (auto &entry : msg.body.keyValueMap) {
+        pos = putFlatBytes(pos, entry.first);
+        pos = putFlatBytes(pos, entry.second);
+    }
+}
+
+/**
+ * False when data is not a whole flat message, entries are checked as
+ * they are taken with nextFlatEntry()
+ */
+inline bool viewFlat(const char *data, size_t size, MessageView &view) {
+    if (size < sizeof(FlatHeader))
+        return false;
+    memcpy(&view.header, data, sizeof(FlatHeader));
+    if (view.header.magic != FLAT_MAGIC)
+        return false;
+
+    auto *pos = data + sizeof(FlatHeader);
+    auto left = size - sizeof(FlatHeader);
+    if (size_t(view.header.keySize) + view.header.valueSize > left)
+        return false;
+    view.key = BytesView { pos, view.header.keySize };
+    pos += view.header.keySize;
+    view.value = BytesView { pos, view.header.valueSize };
+    pos += view.header.valueSize;
+    view.entries = BytesView { pos, size_t(data + size - pos) };
+    return true;
+}
+
+inline bool takeFlatBytes(BytesView &from, BytesView &bytes) {
+    auto size = FlatLength(0);
+    if (from.size < sizeof(size))
+        return false;
+    memcpy(&size, from.data, sizeof(size));
+    if (size > from.size - sizeof(size))
+        return false;
+    bytes = BytesView { from.data + sizeof(size), size };
+    from.data += sizeof(size) + size;
+    from.size -= sizeof(size) + size;
+    return true;
+}
+
+// Takes the next keyValueMap entry off entries, false when torn
+inline bool nextFlatEntry(BytesView &entries, BytesView &key,
+                          BytesView &value) {
+    return takeFlatBytes(entries, key) && takeFlatBytes(entries, value);
+}
+
+/**
+ * Fill parts of a message from the view. Strings are assigned over, so a
+ * message reused for many decodes keeps their memory.
+ */
+inline void materializeHeader(const MessageView &view, Header &header) {
+    auto &flatHeader = view.header;
+    header.type = ReqType::type(flatHeader.type);
+    header.status = ReqStatus::type(flatHeader.status);
+    header.seqId = flatHeader.seqId;
+    header.transaction = flatHeader.transaction;
+    header.srcPort = flatHeader.srcPort;
+
+    // Same bytes encodeAsIp6() gives, without a temporary string
+    auto &ip6Bytes = header.srcAddr.bytes;
+    ip6Bytes.assign(16, 0);
+    ip6Bytes[10] = (char)0xFF;
+    ip6Bytes[11] = (char)0xFF;
+    memcpy(&ip6Bytes[12], &flatHeader.srcIp, sizeof(flatHeader.srcIp));
+}
+
+inline bool materializeBody(const MessageView &view, Body &body) {
+    body.key.assign(view.key.data, view.key.size);
+    body.value.assign(view.value.data, view.value.size);
+    body.keyValueMap.clear();
+
+    auto entries = view.entries;
+    BytesView key, value;
+    for (auto i = 0; i < view.header.entriesCount; ++i) {
+        if (!nextFlatEntry(entries, key, value))
+            return false;
+        body.keyValueMap.emplace(std::string(key.data, key.size),
+                                 std::string(value.data, value.size));
+    }
+    return true;
+}
+
+inline bool materialize(const MessageView &view, Message &msg) {
+    materializeHeader(view, msg.header);
+    return materializeBody(view, msg.body);
+}
+
+}
+}
+
+#endif
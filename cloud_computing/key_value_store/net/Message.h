@@ -2,6 +2,7 @@
 #define MESSAGE_H_
 
 #include "Address.h"
+#include "net/FlatMessage.h"
 #include "net/Transport.h"
 
 
@@ -12,9 +13,11 @@
 #include <thrift/protocol/TBinaryProtocol.h>
 #include <thrift/protocol/TCompactProtocol.h>
 #include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TVirtualTransport.h>
 
 #include <boost/make_shared.hpp>
 
+#include <cerrno>
 #include <memory>
 #include <string>
 #include <vector>
@@ -53,60 +56,294 @@ inline string encodeAsIp6(uint32_t ip4) {
     return ip6Bytes;
 }
 
+// Widest compact protocol varint of a 32 bit length or integer
+static const size_t COMPACT_VARINT_MAX  = 5;
+// Compact encoding of a Message without its strings: field headers, stop
+// bytes, integers and string lengths of Header, Body and the map header,
+// every varint at its widest
+static const size_t COMPACT_FIXED_BOUND = 64;
+// Messages taken from the transport by a single dequeueBatch()
+static const size_t RECV_BATCH_SIZE = 64;
+// Field ids of Message in dht_proto.thrift
+static const int16_t MSG_HEADER_FIELD = 1;
+static const int16_t MSG_BODY_FIELD   = 3;
+
+/**
+ * Bytes the compact encoding of msg takes at most, so an encode into a
+ * payload of that size never runs out of room
+ */
+inline size_t getCompactSizeBound(const proto::dht::Message &msg) {
+    auto size = COMPACT_FIXED_BOUND + msg.header.srcAddr.bytes.size()
+              + msg.body.key.size() + msg.body.value.size();
+    for (auto &entry : msg.body.keyValueMap) {
+        size += 2 * COMPACT_VARINT_MAX + entry.first.size()
+              + entry.second.size();
+    }
+    return size;
+}
+
+/**
+ * Write only Thrift transport over a fixed buffer, throws once it is full
+ */
+class PayloadWriter : public TVirtualTransport<PayloadWriter> {
+public:
+    void reset(char *data, size_t size) {
+        begin = data;
+        pos = data;
+        end = data + size;
+    }
+
+    size_t written() const {
+        return pos - begin;
+    }
+
+    void write(const uint8_t *buf, uint32_t len) {
+        if (len > size_t(end - pos))
+            throw TTransportException("Message does not fit the payload");
+        memcpy(pos, buf, len);
+        pos += len;
+    }
+
+    uint32_t read(uint8_t *, uint32_t) {
+        throw TTransportException("PayloadWriter is write only");
+    }
+
+private:
+    char *begin = nullptr;
+    char *pos   = nullptr;
+    char *end   = nullptr;
+};
+
 class MessageQueue {
     using Msg = proto::dht::Message;
     using Protocol = TCompactProtocol;
     using MemoryBufferPtr = boost::shared_ptr<TMemoryBuffer>;
+    using PayloadWriterPtr = boost::shared_ptr<PayloadWriter>;
     using ProtocolPtr = boost::shared_ptr<TCompactProtocol>;
     using TransportPtr = std::shared_ptr<net::Transport>;
 
 public:
-    MessageQueue(std::shared_ptr<net::Transport> net)
-        : transport(net),
+    MessageQueue(std::shared_ptr<net::Transport> net,
+                 WireFormat format = WireFormat::THRIFT_COMPACT)
+        : transport(net), format(format),
           inputBuffer(boost::make_shared<TMemoryBuffer>(nullptr, 0)),
-          outputBuffer(boost::make_shared<TMemoryBuffer>()),
+          payloadWriter(boost::make_shared<PayloadWriter>()),
           inputProtocol(boost::make_shared<Protocol>(inputBuffer)),
-          outputProtocol(boost::make_shared<Protocol>(outputBuffer)) {
+          outputProtocol(boost::make_shared<Protocol>(payloadWriter)),
+          recvBatch(RECV_BATCH_SIZE) {
         addr = transport->getAddress();
     }
 
-    void send(Address remote, Msg &msg) {
-        outputBuffer->resetBuffer();
-        msg.write(outputProtocol.get());
-        auto size = outputBuffer->available_read();
-        auto *buf = outputBuffer->borrow(nullptr, &size);
-        transport->send(remote, (char*)buf, size);
+    // Serializes straight into a transport buffer. Empty buffer when the
+    // message is larger than any payload the transport takes.
+    PooledBuffer encode(const Msg &msg) {
+        if (format == WireFormat::FLAT)
+            return encodeFlat(msg);
+        // The bound is exact enough that only messages close to the largest
+        // payload can overflow, and only those are encoded on trial
+        auto maxSize = transport->getMaxPayload();
+        return encodeInto(msg, std::min(getCompactSizeBound(msg), maxSize));
+    }
+
+    // Returns size sent or negative errno from the transport (-EAGAIN when
+    // the link has to be throttled)
+    int send(Address remote, const Msg &msg) {
+        auto payload = encode(msg);
+        if (payload.empty())
+            return -EMSGSIZE;
+        return transport->commit(remote, move(payload));
+    }
+
+    // Sends a message from encode(), every destination gets a handle to
+    // the same bytes
+    int send(Address remote, PooledBuffer &encoded) {
+        if (encoded.empty())
+            return -EMSGSIZE;
+        return transport->commit(remote, encoded.share());
+    }
+
+    void onWritable(net::Transport::WritableCallback callback) {
+        transport->onWritable(move(callback));
+    }
+
+    // Runs the writable callbacks, only where the node sends
+    void notifyWritable() {
+        transport->notifyWritable();
     }
 
     bool recieveMessages() {
         return transport->drain();
     }
 
+    void flush() {
+        transport->flush();
+    }
+
+    bool isThrottled() {
+        return transport->hasBlockedLinks();
+    }
+
     Msg dequeue() {
         auto iobuf = transport->recieve();
-        inputBuffer->resetBuffer((uint8_t *)iobuf.data, iobuf.size);
-
         auto msg = proto::dht::Message();
-        msg.read(inputProtocol.get());
-
-        free(iobuf.data);
+        decode(iobuf, msg);
         return msg;
     }
 
+    // Decodes up to RECV_BATCH_SIZE waiting messages into the front of
+    // msgs and returns how many. Messages already in msgs are decoded over,
+    // so their strings keep the memory of earlier batches. Buffers of the
+    // batch go back to the transport together once all are decoded.
+    size_t dequeueBatch(std::vector<Msg> &msgs) {
+        auto count = peekBatch(msgs);
+        for (size_t i = 0; i < count; ++i)
+            decodeBody(i, msgs[i]);
+        releaseBatch();
+        return count;
+    }
+
+    // Like dequeueBatch(), but decodes only headers. Buffers stay until
+    // the next batch, so decodeBody() can fill in bodies of the messages
+    // that need them.
+    size_t peekBatch(std::vector<Msg> &msgs) {
+        releaseBatch();
+        batchSize = transport->recieveBatch(recvBatch.data(),
+                                            recvBatch.size());
+        if (msgs.size() < batchSize)
+            msgs.resize(batchSize);
+
+        for (size_t i = 0; i < batchSize; ++i)
+            decodeHeader(recvBatch[i], msgs[i]);
+        return batchSize;
+    }
+
+    // Body of message msgIdx of the last peekBatch()
+    void decodeBody(size_t msgIdx, Msg &msg) {
+        auto &iobuf = recvBatch[msgIdx];
+        if (format == WireFormat::FLAT) {
+            auto view = MessageView();
+            if (!viewFlat((const char *)iobuf.data, iobuf.size, view)
+                    || !materializeBody(view, msg.body)) {
+                throw TProtocolException(TProtocolException::INVALID_DATA);
+            }
+            return;
+        }
+
+        // Header was read before, now it is only skipped
+        inputBuffer->resetBuffer((uint8_t *)iobuf.data, iobuf.size);
+        auto *protocol = inputProtocol.get();
+        std::string name;
+        TType type;
+        int16_t fieldId;
+        protocol->readStructBegin(name);
+        while (true) {
+            protocol->readFieldBegin(name, type, fieldId);
+            if (type == T_STOP)
+                break;
+            if (fieldId == MSG_BODY_FIELD && type == T_STRUCT)
+                msg.body.read(protocol);
+            else
+                protocol->skip(type);
+            protocol->readFieldEnd();
+        }
+        protocol->readStructEnd();
+    }
+
     Address getLocalAddress() {
         return addr;
     }
 
+    // Largest encoded message the transport takes
+    size_t getMaxPayload() {
+        return transport->getMaxPayload();
+    }
+
     bool empty() {
         return !transport->pollnb();
     }
 
 private:
+    // Flat size is known up front, the buffer is reserved to fit exactly
+    PooledBuffer encodeFlat(const Msg &msg) {
+        auto size = flatSize(msg);
+        if (size > transport->getMaxPayload())
+            return PooledBuffer();
+        auto payload = transport->reserve(size);
+        proto::dht::encodeFlat(msg, payload.data());
+        return payload;
+    }
+
+    // Reads only the header when it comes first, as it does from
+    // encode(). Otherwise decodes the whole message.
+    void decodeHeader(const IOBuf &iobuf, Msg &msg) {
+        if (format == WireFormat::FLAT) {
+            auto view = MessageView();
+            if (!viewFlat((const char *)iobuf.data, iobuf.size, view))
+                throw TProtocolException(TProtocolException::INVALID_DATA);
+            materializeHeader(view, msg.header);
+            return;
+        }
+
+        inputBuffer->resetBuffer((uint8_t *)iobuf.data, iobuf.size);
+        auto *protocol = inputProtocol.get();
+        std::string name;
+        TType type;
+        int16_t fieldId;
+        protocol->readStructBegin(name);
+        protocol->readFieldBegin(name, type, fieldId);
+        auto headerFirst = fieldId == MSG_HEADER_FIELD && type == T_STRUCT;
+        if (headerFirst) {
+            msg.header.read(protocol);
+            protocol->readFieldEnd();
+        }
+        // Reads no bytes, only balances readStructBegin()
+        protocol->readStructEnd();
+        if (!headerFirst)
+            decode(iobuf, msg);
+    }
+
+    void releaseBatch() {
+        for (size_t i = 0; i < batchSize; ++i)
+            recvBatch[i].owner.reset();
+        batchSize = 0;
+    }
+
+    void decode(const IOBuf &iobuf, Msg &msg) {
+        if (format == WireFormat::FLAT) {
+            auto view = MessageView();
+            if (!viewFlat((const char *)iobuf.data, iobuf.size, view)
+                    || !materialize(view, msg)) {
+                throw TProtocolException(TProtocolException::INVALID_DATA);
+            }
+            return;
+        }
+        inputBuffer->resetBuffer((uint8_t *)iobuf.data, iobuf.size);
+        msg.read(inputProtocol.get());
+    }
+
+    PooledBuffer encodeInto(const Msg &msg, size_t size) {
+        auto payload = transport->reserve(size);
+        payloadWriter->reset(payload.data(), size);
+        try {
+            msg.write(outputProtocol.get());
+        } catch (const TTransportException &) {
+            // The write stopped inside nested structs, the protocol still
+            // holds their field state and cannot be reused
+            outputProtocol = boost::make_shared<Protocol>(payloadWriter);
+            return PooledBuffer();
+        }
+        payload.truncate(payloadWriter->written());
+        return payload;
+    }
+
     TransportPtr        transport;
+    WireFormat          format;
     MemoryBufferPtr     inputBuffer;
-    MemoryBufferPtr     outputBuffer;
+    PayloadWriterPtr    payloadWriter;
     ProtocolPtr         inputProtocol;
     ProtocolPtr         outputProtocol;
+    std::vector<IOBuf>  recvBatch;
+    size_t              batchSize = 0;
     Address             addr;
 };
 
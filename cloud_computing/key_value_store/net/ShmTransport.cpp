@@ -0,0 +1,249 @@
+#include "simulator/Queue.h"
+#include "ShmTransport.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace net {
+
+static const uint32_t SHM_RING_MAGIC = 0x6b767368;    // "kvsh"
+
+/**
+ * Bounded MPSC queue in the style of Vyukov's array queue. Sequence of a
+ * slot tells who may touch it next: producer of position pos waits for
+ * seq == pos, the consumer for seq == pos + 1.
+ */
+struct ShmSlot {
+    std::atomic<uint64_t>   seq;
+    uint32_t                size;
+    uint32_t                pad;
+    char                    data[SHM_SLOT_PAYLOAD];
+};
+
+struct ShmRing {
+    uint32_t                            magic;
+    uint32_t                            slotsCount;
+    alignas(64) std::atomic<uint64_t>   tail;       // next position to claim
+    alignas(64) std::atomic<uint64_t>   head;       // next position to read
+    alignas(64) std::atomic<uint32_t>   wakeups;    // futex word
+    std::atomic<uint32_t>               sleepers;
+    alignas(64) ShmSlot                 slots[SHM_RING_SLOTS];
+};
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t)
+              && sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "ring atomics are shared between processes");
+
+static int futex(std::atomic<uint32_t> *word, int op, uint32_t value,
+                 const timespec *timeout) {
+    return (int)syscall(SYS_futex, (uint32_t *)word, op, value, timeout,
+                        nullptr, 0);
+}
+
+static ShmRing *mapSegment(int fd) {
+    auto *mem = mmap(nullptr, sizeof(ShmRing), PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+    close(fd);
+    return mem == MAP_FAILED ? nullptr : (ShmRing *)mem;
+}
+
+ShmTransport::ShmTransport(Inbox *inQueue, Address address,
+                           uint16_t ringsNamespace, int sendWindow)
+        : Transport(address, sendWindow) {
+    this->inQueue = inQueue;
+    this->ringsNamespace = ringsNamespace;
+
+    // Leftover of a previous run would be mapped by the peers as it is
+    auto name = segmentName(address);
+    shm_unlink(name.c_str());
+    auto fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 || ftruncate(fd, sizeof(ShmRing)) != 0) {
+        perror("ShmTransport: shm_open");
+        exit(1);
+    }
+    inbox = mapSegment(fd);
+    if (inbox == nullptr) {
+        perror("ShmTransport: mmap");
+        exit(1);
+    }
+
+    new (&inbox->tail) std::atomic<uint64_t>(0);
+    new (&inbox->head) std::atomic<uint64_t>(0);
+    new (&inbox->wakeups) std::atomic<uint32_t>(0);
+    new (&inbox->sleepers) std::atomic<uint32_t>(0);
+    for (uint32_t pos = 0; pos < SHM_RING_SLOTS; ++pos)
+        new (&inbox->slots[pos].seq) std::atomic<uint64_t>(pos);
+    inbox->slotsCount = SHM_RING_SLOTS;
+    // Peers check the magic before using the ring
+    std::atomic_thread_fence(std::memory_order_release);
+    inbox->magic = SHM_RING_MAGIC;
+}
+
+ShmTransport::~ShmTransport() {
+    // Inbox messages were copied to the pool of this transport
+    while (!inQueue->empty())
+        inQueue->pop();
+    for (auto &peer : peers)
+        munmap(peer.second, sizeof(ShmRing));
+    munmap(inbox, sizeof(ShmRing));
+    shm_unlink(segmentName(address).c_str());
+}
+
+std::string ShmTransport::segmentName(const Address &node) {
+    return "/kvstore-" + std::to_string(ringsNamespace)
+         + "-" + std::to_string(node.getIp());
+}
+
+/**
+ * Maps inbox ring of the remote, null while the remote is not up yet
+ */
+ShmRing* ShmTransport::mapPeer(const Address &remote) {
+    auto peer = peers.find(remote);
+    if (peer != peers.end())
+        return peer->second;
+
+    auto fd = shm_open(segmentName(remote).c_str(), O_RDWR, 0);
+    if (fd < 0)
+        return nullptr;
+    auto *ring = mapSegment(fd);
+    if (ring == nullptr)
+        return nullptr;
+    if (ring->magic != SHM_RING_MAGIC) {
+        munmap(ring, sizeof(ShmRing));
+        return nullptr;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    peers[remote] = ring;
+    return ring;
+}
+
+/**
+ * Returns len on success, -EAGAIN when the remote ring is full and
+ * -EMSGSIZE when the message does not fit a slot. Message to a node that
+ * is not up is lost, like a datagram would be.
+ */
+int ShmTransport::send(Address remote, char *data, size_t len) {
+    if (len > SHM_SLOT_PAYLOAD) {
+        stats.tooLarge++;
+        return -EMSGSIZE;
+    }
+    auto *ring = mapPeer(remote);
+    if (ring == nullptr) {
+        stats.sent++;
+        return len;
+    }
+
+    auto pos = ring->tail.load(std::memory_order_relaxed);
+    ShmSlot *slot;
+    while (true) {
+        slot = &ring->slots[pos & (SHM_RING_SLOTS - 1)];
+        auto seq = slot->seq.load(std::memory_order_acquire);
+        auto diff = int64_t(seq) - int64_t(pos);
+        if (diff == 0 && ring->tail.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed)) {
+            break;
+        }
+        if (diff < 0) {
+            markBlocked(remote);
+            return -EAGAIN;
+        }
+        if (diff > 0)
+            pos = ring->tail.load(std::memory_order_relaxed);
+    }
+
+    memcpy(slot->data, data, len);
+    slot->size = len;
+    slot->seq.store(pos + 1, std::memory_order_release);
+    stats.sent++;
+
+    // Consumer announces itself before sleeping, no syscall otherwise
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ring->sleepers.load(std::memory_order_seq_cst) > 0) {
+        ring->wakeups.fetch_add(1, std::memory_order_seq_cst);
+        futex(&ring->wakeups, FUTEX_WAKE, INT_MAX, nullptr);
+        stats.syscalls++;
+    }
+    return len;
+}
+
+/**
+ * Credits of a link are the free slots of remote ring, shared by every
+ * sender of the remote.
+ */
+// Slots live in the ring of the receiver, so commit() copies into them
+size_t ShmTransport::getMaxPayload() {
+    return SHM_SLOT_PAYLOAD;
+}
+
+int ShmTransport::getCredits(const Address &remote) {
+    auto *ring = mapPeer(remote);
+    if (ring == nullptr)
+        return sendWindow;
+    auto used = ring->tail.load(std::memory_order_relaxed)
+              - ring->head.load(std::memory_order_relaxed);
+    return std::min<int>(sendWindow, SHM_RING_SLOTS - used);
+}
+
+/**
+ * Copies everything published in the inbox ring to the inbox queue and
+ * frees the slots at once, so senders get their credits back. Slots stay
+ * taken while the inbox queue is full.
+ */
+bool ShmTransport::drain() {
+    auto pos = inbox->head.load(std::memory_order_relaxed);
+    auto room = inQueue->freeSlots();
+    for (; room > 0; --room) {
+        auto &slot = inbox->slots[pos & (SHM_RING_SLOTS - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != pos + 1)
+            break;
+        auto buffer = pool.allocate(slot.size);
+        memcpy(buffer.data(), slot.data, slot.size);
+        Queue::enqueue(inQueue, move(buffer));
+        slot.seq.store(pos + SHM_RING_SLOTS, std::memory_order_release);
+        inbox->head.store(++pos, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+/**
+ * Sleeps on the inbox futex until a producer publishes a message
+ */
+bool ShmTransport::wait(int timeoutMs) {
+    if (pollnb())
+        return true;
+
+    auto timeout = timespec { timeoutMs / 1000, (timeoutMs % 1000) * 1000000L };
+    inbox->sleepers.fetch_add(1, std::memory_order_seq_cst);
+    auto seen = inbox->wakeups.load(std::memory_order_seq_cst);
+    auto &next = inbox->slots[inbox->head.load() & (SHM_RING_SLOTS - 1)];
+    if (next.seq.load(std::memory_order_acquire)
+            != inbox->head.load() + 1) {
+        futex(&inbox->wakeups, FUTEX_WAIT, seen,
+              timeoutMs < 0 ? nullptr : &timeout);
+        stats.syscalls++;
+    }
+    inbox->sleepers.fetch_sub(1, std::memory_order_seq_cst);
+    drain();
+    return pollnb();
+}
+
+bool ShmTransport::pollnb() {
+    return !inQueue->empty();
+}
+
+IOBuf ShmTransport::recieve() {
+    return popInbox(inQueue);
+}
+
+} // namespace net
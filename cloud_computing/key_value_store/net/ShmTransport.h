@@ -0,0 +1,57 @@
+#ifndef SHMTRANSPORT_H_
+#define SHMTRANSPORT_H_
+
+#include "net/Transport.h"
+#include "simulator/BufferPool.h"
+
+#include <atomic>
+#include <string>
+#include <unordered_map>
+
+namespace net {
+
+// Slots in the inbox ring of every node, power of two
+static const uint32_t SHM_RING_SLOTS = 256;
+// Largest message carried by a single slot
+static const size_t   SHM_SLOT_PAYLOAD = 8192 - 16;
+
+struct ShmRing;
+
+/**
+ * Transport between processes of one host. Each node owns a shared memory
+ * segment named after its id with a bounded MPSC ring of fixed size slots,
+ * senders map the segments of their peers and claim slots with a CAS on
+ * the ring tail. A consumer blocked in wait() sleeps on a futex in the
+ * segment and the producer wakes it only when it announced itself.
+ * Credits of a link are the free slots of the destination ring.
+ */
+class ShmTransport : public Transport {
+public:
+    ShmTransport(Inbox *inQueue, Address address, uint16_t ringsNamespace,
+                 int sendWindow = DEFAULT_SEND_WINDOW);
+    ShmTransport(const ShmTransport&)            = delete;
+    ShmTransport& operator=(const ShmTransport&) = delete;
+    ~ShmTransport();
+
+    bool    drain() override;
+    bool    pollnb() override;
+    int     send(Address remote, char *data, size_t len) override;
+    int     getCredits(const Address &remote) override;
+    IOBuf   recieve() override;
+    bool    wait(int timeoutMs) override;
+    size_t  getMaxPayload() override;
+
+private:
+    std::string segmentName(const Address &node);
+    ShmRing*    mapPeer(const Address &remote);
+
+    uint16_t                                ringsNamespace;
+    Inbox                                   *inQueue;
+    BufferPool                              pool;
+    ShmRing                                 *inbox;
+    std::unordered_map<Address, ShmRing *>  peers;
+};
+
+} // namespace net
+
+#endif
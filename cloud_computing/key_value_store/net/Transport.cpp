@@ -3,43 +3,177 @@
 #include "simulator/Queue.h"
 #include "Transport.h"
 
+#include <algorithm>
+#include <cerrno>
+
 namespace net {
 
-Transport::Transport(EmulNet *emulNet, queue<q_elt> *inQueue, Address address) {
-    this->emulNet = emulNet;
+/******************************************************************************
+ * Transport
+ ******************************************************************************/
+Transport::Transport(Address address, int sendWindow) : stats{0, 0, 0, 0} {
     this->address = address;
-    this->inQueue = inQueue;
+    this->sendWindow = sendWindow;
 }
 
-static int enqueueMsgCallback(void *env, char *buff, int size) {
-    return Queue::enqueue((queue<q_elt> *)env, (void *)buff, size);
+void Transport::onWritable(WritableCallback callback) {
+    writableCallbacks.push_back(move(callback));
 }
 
-bool Transport::drain() {
-    return emulNet->ENrecv(&address, enqueueMsgCallback,
-                           nullptr, 1, inQueue);
+PooledBuffer Transport::reserve(size_t len) {
+    return scratchPool.allocate(len);
 }
 
-int Transport::send(Address remote, char *data, size_t len) {
-    return emulNet->ENsend(&address, &remote, (char *)data, len);
+int Transport::commit(Address remote, PooledBuffer &&payload) {
+    return send(move(remote), payload.data(), payload.size());
 }
 
-bool Transport::pollnb() {
-    return !inQueue->empty();
+size_t Transport::recieveBatch(IOBuf *bufs, size_t count) {
+    auto received = size_t(0);
+    while (received < count && pollnb()) {
+        auto buf = recieve();
+        if (buf.data != nullptr)
+            bufs[received++] = move(buf);
+    }
+    return received;
+}
+
+bool Transport::hasBlockedLinks() {
+    return !blockedRemotes.empty();
+}
+
+Address Transport::getAddress() {
+    return address;
+}
+
+TransportStats Transport::getStats() {
+    return stats;
 }
 
-IOBuf Transport::recieve() {
-    auto buf = IOBuf { nullptr, 0 };
+void Transport::markBlocked(const Address &remote) {
+    stats.wouldBlock++;
+    if (find(blockedRemotes.begin(), blockedRemotes.end(), remote)
+            == blockedRemotes.end()) {
+        blockedRemotes.push_back(remote);
+    }
+}
+
+/**
+ * Calls back for every blocked link that got its credits back, callbacks
+ * may send again and block the same link one more time.
+ */
+void Transport::notifyWritable() {
+    if (blockedRemotes.empty())
+        return;
+
+    unblockedRemotes.clear();
+    auto isWritable = [this](const Address &remote) {
+        if (getCredits(remote) <= 0)
+            return false;
+        unblockedRemotes.push_back(remote);
+        return true;
+    };
+    blockedRemotes.erase(remove_if(blockedRemotes.begin(),
+                                   blockedRemotes.end(), isWritable),
+                         blockedRemotes.end());
+
+    for (auto &remote : unblockedRemotes) {
+        for (auto &callback : writableCallbacks) {
+            callback(remote);
+        }
+    }
+}
+
+IOBuf popInbox(Inbox *inQueue) {
+    auto buf = IOBuf();
     if (!inQueue->empty()) {
-        auto msg = inQueue->front();
+        auto &buffer = inQueue->front().buffer;
+        buf = IOBuf { buffer.data(), buffer.size(), move(buffer) };
         inQueue->pop();
-        buf = IOBuf { msg.elt, size_t(msg.size) };
     }
     return buf;
 }
 
-Address Transport::getAddress() {
-    return address;
+/******************************************************************************
+ * EmulNetTransport
+ ******************************************************************************/
+EmulNetTransport::EmulNetTransport(EmulNet *emulNet, Inbox *inQueue,
+                                   Address address, int sendWindow)
+        : Transport(address, sendWindow) {
+    this->emulNet = emulNet;
+    this->inQueue = inQueue;
+}
+
+static int enqueueMsgCallback(void *env, PooledBuffer &&buff) {
+    return Queue::enqueue((Inbox *)env, move(buff));
+}
+
+bool EmulNetTransport::drain() {
+    return emulNet->ENrecv(&address, enqueueMsgCallback, nullptr, 1, inQueue);
+}
+
+/**
+ * Returns len on success, -EAGAIN when the link has no credits left,
+ * -EMSGSIZE when the message can never be sent.
+ * Message lost by the network still counts as sent, like a datagram would.
+ */
+int EmulNetTransport::send(Address remote, char *data, size_t len) {
+    if (len > getMaxPayload()) {
+        stats.tooLarge++;
+        return -EMSGSIZE;
+    }
+    auto payload = reserve(len);
+    memcpy(payload.data(), data, len);
+    return commit(move(remote), move(payload));
+}
+
+/**
+ * Payload goes to the mailbox of remote as it is
+ */
+int EmulNetTransport::commit(Address remote, PooledBuffer &&payload) {
+    auto len = int(payload.size());
+    if (getCredits(remote) <= 0) {
+        markBlocked(remote);
+        emulNet->ENblocked(&address);
+        return -EAGAIN;
+    }
+
+    auto result = emulNet->ENsend(&address, &remote, move(payload));
+    if (result == -EMSGSIZE) {
+        stats.tooLarge++;
+        return result;
+    }
+    if (result == -EAGAIN) {
+        markBlocked(remote);
+        return result;
+    }
+    stats.sent++;
+    return len;
+}
+
+PooledBuffer EmulNetTransport::reserve(size_t len) {
+    return emulNet->ENalloc(len);
+}
+
+size_t EmulNetTransport::getMaxPayload() {
+    return emulNet->ENmaxPayload();
+}
+
+/**
+ * Credits of a link come back when the remote drains its mailbox
+ */
+int EmulNetTransport::getCredits(const Address &remote) {
+    auto linkCredits = sendWindow - emulNet->ENinflight(&address,
+                                                       (Address *)&remote);
+    return std::min(linkCredits, emulNet->ENcapacity());
+}
+
+bool EmulNetTransport::pollnb() {
+    return !inQueue->empty();
+}
+
+IOBuf EmulNetTransport::recieve() {
+    return popInbox(inQueue);
 }
 
 
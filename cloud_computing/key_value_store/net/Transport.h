@@ -3,32 +3,125 @@
 
 #include "simulator/Member.h"
 
+#include <functional>
 #include <queue>
+#include <vector>
 using std::queue;
 
 struct IOBuf {
-    void    *data;
-    size_t  size;
+    void            *data;
+    size_t          size;
+    PooledBuffer    owner;
+};
+
+struct TransportStats {
+    uint64_t sent;          // messages accepted by the network
+    uint64_t wouldBlock;    // sends refused for lack of credits
+    uint64_t tooLarge;      // sends refused because of payload size
+    uint64_t syscalls;      // kernel calls made to move the messages
 };
 
 class EmulNet;
 
 namespace net {
 
+// Messages allowed in flight on a single link before send() would block
+static const int DEFAULT_SEND_WINDOW = 64;
+
+/**
+ * Datagram transport of a single node.
+ *
+ * Every destination grants a window of credits to each sender, a credit is
+ * taken per message sent and comes back once the message leaves the sender
+ * side queues. When a link runs out of credits send() returns -EAGAIN and
+ * the writable callbacks are called from notifyWritable() once the link has
+ * credits again.
+ *
+ * Nodes run in parallel phases, all of them drain their inboxes and then
+ * all of them send. drain() only receives, checking credits or sending
+ * there would touch mailboxes of nodes draining at the same time.
+ */
 class Transport {
 public:
-    Transport(EmulNet *emulNet, queue<q_elt> *inQueue, Address address);
-    bool    drain();
-    bool    pollnb();
-    int     send(Address remote, char *data, size_t len);
-    IOBuf   recieve();
-    Address getAddress();
+    using WritableCallback = std::function<void(const Address&)>;
+
+    virtual ~Transport() = default;
+
+    // Moves messages that arrived from the network to the inbox
+    virtual bool    drain()                                         = 0;
+    // True when the inbox is not empty
+    virtual bool    pollnb()                                        = 0;
+    virtual int     send(Address remote, char *data, size_t len)    = 0;
+    virtual int     getCredits(const Address &remote)               = 0;
+    virtual IOBuf   recieve()                                       = 0;
+    // Moves up to count messages of the inbox to bufs, returns how many
+    virtual size_t  recieveBatch(IOBuf *bufs, size_t count);
+    // Largest payload a single send takes
+    virtual size_t  getMaxPayload()                                 = 0;
+    // Zero copy send: write the payload into a buffer from reserve(),
+    // truncate it to the bytes written and pass it to commit(), which
+    // returns like send(). Handles from PooledBuffer::share() let many
+    // destinations take the same bytes. Backends that own no buffers copy.
+    // A failed commit leaves the payload with the caller.
+    virtual PooledBuffer    reserve(size_t len);
+    virtual int             commit(Address remote, PooledBuffer &&payload);
+    // Pushes out sends batched by the transport, called at the end of tick
+    virtual void    flush() {}
+    // Blocks up to timeoutMs for messages, backends without wakeups do not
+    virtual bool    wait(int) { return pollnb(); }
+    // Calls back for every blocked link that got its credits back, called
+    // by the node where it sends, before anything else goes out
+    virtual void    notifyWritable();
+
+    void            onWritable(WritableCallback callback);
+    // True while some link waits for its credits to come back
+    bool            hasBlockedLinks();
+    Address         getAddress();
+    TransportStats  getStats();
+
+protected:
+    Transport(Address address, int sendWindow);
+    void    markBlocked(const Address &remote);
+
+    Address         address;
+    int             sendWindow;
+    TransportStats  stats;
+    // Backs the default reserve(), has to outlive its buffers
+    BufferPool      scratchPool;
+
+private:
+    std::vector<Address>            blockedRemotes;
+    std::vector<Address>            unblockedRemotes;
+    std::vector<WritableCallback>   writableCallbacks;
+};
+
+/**
+ * Transport over the emulated network, credits of a link come back when
+ * the destination drains its EmulNet mailbox.
+ */
+class EmulNetTransport : public Transport {
+public:
+    EmulNetTransport(EmulNet *emulNet, Inbox *inQueue, Address address,
+                     int sendWindow = DEFAULT_SEND_WINDOW);
+    bool    drain() override;
+    bool    pollnb() override;
+    int     send(Address remote, char *data, size_t len) override;
+    int     getCredits(const Address &remote) override;
+    IOBuf   recieve() override;
+    size_t  getMaxPayload() override;
+    PooledBuffer    reserve(size_t len) override;
+    int             commit(Address remote, PooledBuffer &&payload) override;
+
 private:
     EmulNet         *emulNet;
-    queue<q_elt>    *inQueue;
-    Address         address;
+    Inbox           *inQueue;
 };
 
+/**
+ * Pops the first message of inbox, empty buffer if there is none
+ */
+IOBuf popInbox(Inbox *inQueue);
+
 } // namespace net
 
 #endif
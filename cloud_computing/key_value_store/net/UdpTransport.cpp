@@ -0,0 +1,213 @@
+#include "simulator/Queue.h"
+#include "UdpTransport.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+namespace net {
+
+// Datagrams waiting in the send batch before every link blocks
+static const size_t UDP_MAX_BATCHED = 4096;
+static const int    UDP_SOCKET_BUFFER = 4 * 1024 * 1024;
+
+UdpTransport::UdpTransport(Inbox *inQueue, Address address,
+                           uint16_t basePort, int sendWindow)
+        : Transport(address, sendWindow),
+          sendAddrs(UDP_BATCH_SIZE), sendIovecs(UDP_BATCH_SIZE),
+          sendHeaders(UDP_BATCH_SIZE), recvBuffers(UDP_BATCH_SIZE),
+          recvIovecs(UDP_BATCH_SIZE), recvHeaders(UDP_BATCH_SIZE) {
+    this->inQueue = inQueue;
+    this->basePort = basePort;
+
+    sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        perror("UdpTransport: socket");
+        exit(1);
+    }
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF,
+               &UDP_SOCKET_BUFFER, sizeof(UDP_SOCKET_BUFFER));
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF,
+               &UDP_SOCKET_BUFFER, sizeof(UDP_SOCKET_BUFFER));
+
+    auto local = toSockAddr(address);
+    if (bind(sock, (sockaddr *)&local, sizeof(local)) != 0) {
+        perror("UdpTransport: bind");
+        exit(1);
+    }
+}
+
+UdpTransport::~UdpTransport() {
+    close(sock);
+    // Buffers still in the inbox come from this transport pool
+    while (!inQueue->empty())
+        inQueue->pop();
+}
+
+sockaddr_in UdpTransport::toSockAddr(const Address &remote) {
+    sockaddr_in sockAddr;
+    memset(&sockAddr, 0, sizeof(sockAddr));
+    sockAddr.sin_family = AF_INET;
+    sockAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sockAddr.sin_port = htons(uint16_t(basePort + remote.getIp()));
+    return sockAddr;
+}
+
+/**
+ * Flushes pending sends and moves what the socket has to the inbox, as
+ * much as the inbox takes. The rest waits in the socket buffer.
+ */
+bool UdpTransport::drain() {
+    flush();
+
+    while (true) {
+        auto batchSize = std::min(UDP_BATCH_SIZE, inQueue->freeSlots());
+        if (batchSize == 0)
+            break;
+        for (size_t i = 0; i < batchSize; ++i) {
+            if (recvBuffers[i].empty())
+                recvBuffers[i] = pool.allocate(UDP_MAX_DATAGRAM);
+            recvIovecs[i] = iovec { recvBuffers[i].data(), UDP_MAX_DATAGRAM };
+            memset(&recvHeaders[i], 0, sizeof(mmsghdr));
+            recvHeaders[i].msg_hdr.msg_iov = &recvIovecs[i];
+            recvHeaders[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        auto count = recvmmsg(sock, recvHeaders.data(), batchSize,
+                              MSG_DONTWAIT, nullptr);
+        stats.syscalls++;
+        if (count <= 0)
+            break;
+
+        for (auto i = 0; i < count; ++i) {
+            if (recvHeaders[i].msg_hdr.msg_flags & MSG_TRUNC)
+                continue;
+            recvBuffers[i].truncate(recvHeaders[i].msg_len);
+            Queue::enqueue(inQueue, move(recvBuffers[i]));
+        }
+        if (size_t(count) < batchSize)
+            break;
+    }
+    return true;
+}
+
+/**
+ * Returns len when the datagram joined the send batch, -EAGAIN when the
+ * link has no credits left, -EMSGSIZE when it would not fit a datagram.
+ */
+int UdpTransport::send(Address remote, char *data, size_t len) {
+    if (len > UDP_MAX_DATAGRAM) {
+        stats.tooLarge++;
+        return -EMSGSIZE;
+    }
+    if (getCredits(remote) <= 0) {
+        markBlocked(remote);
+        return -EAGAIN;
+    }
+
+    auto payload = reserve(len);
+    memcpy(payload.data(), data, len);
+    return commit(move(remote), move(payload));
+}
+
+/**
+ * Payload joins the send batch as it is, sendmmsg reads it from there
+ */
+int UdpTransport::commit(Address remote, PooledBuffer &&payload) {
+    auto len = payload.size();
+    if (len > UDP_MAX_DATAGRAM) {
+        stats.tooLarge++;
+        return -EMSGSIZE;
+    }
+    if (getCredits(remote) <= 0) {
+        markBlocked(remote);
+        return -EAGAIN;
+    }
+
+    sendBatch.push_back(Datagram { remote, move(payload) });
+    batchedPerRemote[remote]++;
+    stats.sent++;
+
+    if (sendBatch.size() % UDP_BATCH_SIZE == 0)
+        flush();
+    return len;
+}
+
+PooledBuffer UdpTransport::reserve(size_t len) {
+    return pool.allocate(len);
+}
+
+size_t UdpTransport::getMaxPayload() {
+    return UDP_MAX_DATAGRAM;
+}
+
+int UdpTransport::getCredits(const Address &remote) {
+    auto batched = batchedPerRemote.find(remote);
+    auto linkCredits = sendWindow - (batched != batchedPerRemote.end()
+                                        ? batched->second : 0);
+    return std::min<int>(linkCredits, UDP_MAX_BATCHED - sendBatch.size());
+}
+
+/**
+ * Sends the batch in sendmmsg chunks. Whatever the socket does not take
+ * right now stays batched and holds its credits until the next flush.
+ */
+void UdpTransport::flush() {
+    size_t sentCount = 0;
+    while (sentCount < sendBatch.size()) {
+        auto chunk = std::min(sendBatch.size() - sentCount, UDP_BATCH_SIZE);
+        for (size_t i = 0; i < chunk; ++i) {
+            auto &datagram = sendBatch[sentCount + i];
+            sendAddrs[i] = toSockAddr(datagram.remote);
+            sendIovecs[i] = iovec { datagram.payload.data(),
+                                    datagram.payload.size() };
+            memset(&sendHeaders[i], 0, sizeof(mmsghdr));
+            sendHeaders[i].msg_hdr.msg_name = &sendAddrs[i];
+            sendHeaders[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            sendHeaders[i].msg_hdr.msg_iov = &sendIovecs[i];
+            sendHeaders[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        auto count = sendmmsg(sock, sendHeaders.data(), chunk, MSG_DONTWAIT);
+        stats.syscalls++;
+        if (count < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+                break;
+            // First datagram of the chunk can not be sent at all, lose it
+            count = 1;
+        }
+        sentCount += count;
+    }
+    releaseSent(sentCount);
+}
+
+/**
+ * Gives back credits of the first count datagrams and drops them
+ */
+void UdpTransport::releaseSent(size_t count) {
+    if (count == 0)
+        return;
+    for (size_t i = 0; i < count; ++i)
+        releaseCredit(sendBatch[i].remote);
+    sendBatch.erase(sendBatch.begin(), sendBatch.begin() + count);
+}
+
+void UdpTransport::releaseCredit(const Address &remote) {
+    auto batched = batchedPerRemote.find(remote);
+    if (--batched->second == 0)
+        batchedPerRemote.erase(batched);
+}
+
+bool UdpTransport::pollnb() {
+    return !inQueue->empty();
+}
+
+IOBuf UdpTransport::recieve() {
+    return popInbox(inQueue);
+}
+
+} // namespace net
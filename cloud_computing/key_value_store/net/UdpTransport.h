@@ -0,0 +1,74 @@
+#ifndef UDPTRANSPORT_H_
+#define UDPTRANSPORT_H_
+
+#include "net/Transport.h"
+#include "simulator/BufferPool.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unordered_map>
+#include <vector>
+
+namespace net {
+
+// Largest datagram accepted, longer ones are truncated by kernel and dropped
+static const size_t UDP_MAX_DATAGRAM = 8192;
+// Datagrams moved by a single sendmmsg/recvmmsg call
+static const size_t UDP_BATCH_SIZE = 32;
+
+/**
+ * Transport over loopback UDP sockets, node with id N listens on
+ * 127.0.0.1:(basePort + N). Sends are batched until flush() and go out with
+ * a single sendmmsg, receives take up to UDP_BATCH_SIZE datagrams per
+ * recvmmsg straight into pooled buffers. Credits of a link come back when
+ * its datagrams leave the send batch.
+ */
+class UdpTransport : public Transport {
+public:
+    UdpTransport(Inbox *inQueue, Address address, uint16_t basePort,
+                 int sendWindow = DEFAULT_SEND_WINDOW);
+    UdpTransport(const UdpTransport&)            = delete;
+    UdpTransport& operator=(const UdpTransport&) = delete;
+    ~UdpTransport();
+
+    bool    drain() override;
+    bool    pollnb() override;
+    int     send(Address remote, char *data, size_t len) override;
+    int     getCredits(const Address &remote) override;
+    IOBuf   recieve() override;
+    void    flush() override;
+    size_t  getMaxPayload() override;
+    PooledBuffer    reserve(size_t len) override;
+    int             commit(Address remote, PooledBuffer &&payload) override;
+
+protected:
+    struct Datagram {
+        Address         remote;
+        PooledBuffer    payload;
+    };
+
+    sockaddr_in toSockAddr(const Address &remote);
+    void        releaseCredit(const Address &remote);
+
+    int                                 sock;
+    Inbox                               *inQueue;
+    // Has to outlive every buffer handed out, declared before the users
+    BufferPool                          pool;
+    std::vector<Datagram>               sendBatch;
+
+private:
+    void        releaseSent(size_t count);
+
+    uint16_t                            basePort;
+    std::unordered_map<Address, int>    batchedPerRemote;
+    std::vector<sockaddr_in>            sendAddrs;
+    std::vector<iovec>                  sendIovecs;
+    std::vector<mmsghdr>                sendHeaders;
+    std::vector<PooledBuffer>           recvBuffers;
+    std::vector<iovec>                  recvIovecs;
+    std::vector<mmsghdr>                recvHeaders;
+};
+
+} // namespace net
+
+#endif
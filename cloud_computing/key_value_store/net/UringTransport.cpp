@@ -0,0 +1,262 @@
+#ifdef USE_IO_URING
+
+#include "simulator/Queue.h"
+#include "UringTransport.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace net {
+
+static const unsigned   URING_ENTRIES       = 256;
+static const unsigned   URING_RECV_BUFFERS  = 128;     // power of two
+static const uint16_t   URING_BUFFER_GROUP  = 0;
+static const uint64_t   URING_RECV_TAG      = ~uint64_t(0);
+// Multishot recvmsg puts its header in front of the payload
+static const size_t     URING_BUFFER_SIZE   = UDP_MAX_DATAGRAM
+                                            + sizeof(io_uring_recvmsg_out);
+
+// Every received datagram holds its buffer until the node takes it from the
+// inbox, so the kernel runs out of buffers before the inbox gets full
+static_assert(URING_RECV_BUFFERS <= INBOX_CAPACITY,
+              "inbox has to take every receive buffer");
+
+static int uringSetup(unsigned entries, io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int fd, unsigned toSubmit, unsigned minComplete,
+                      unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete,
+                        flags, nullptr, 0);
+}
+
+static int uringRegister(int fd, unsigned opcode, void *arg, unsigned count) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+static void *mapOrDie(size_t size, int fd, off_t offset) {
+    auto *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | (fd < 0 ? MAP_ANONYMOUS : MAP_POPULATE),
+                     fd, offset);
+    if (mem == MAP_FAILED) {
+        perror("UringTransport: mmap");
+        exit(1);
+    }
+    return mem;
+}
+
+UringTransport::UringTransport(Inbox *inQueue, Address address,
+                               uint16_t basePort, int sendWindow)
+        : UdpTransport(inQueue, address, basePort, sendWindow),
+          bufArena(URING_RECV_BUFFERS * URING_BUFFER_SIZE),
+          sendSlots(URING_ENTRIES / 2) {
+    // Task work is only run when we enter the kernel, the flag tells when
+    auto params = io_uring_params();
+    params.flags = IORING_SETUP_COOP_TASKRUN | IORING_SETUP_TASKRUN_FLAG;
+    ringFd = uringSetup(URING_ENTRIES, &params);
+    if (ringFd < 0 || !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        perror("UringTransport: io_uring_setup");
+        exit(1);
+    }
+
+    auto sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    auto cqRingSize = params.cq_off.cqes
+                    + params.cq_entries * sizeof(io_uring_cqe);
+    ringMemSize = std::max(sqRingSize, cqRingSize);
+    ringMem = mapOrDie(ringMemSize, ringFd, IORING_OFF_SQ_RING);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = (io_uring_sqe *)mapOrDie(sqesSize, ringFd, IORING_OFF_SQES);
+
+    auto *ring = (char *)ringMem;
+    sqHead  = (unsigned *)(ring + params.sq_off.head);
+    sqTail  = (unsigned *)(ring + params.sq_off.tail);
+    sqMask  = (unsigned *)(ring + params.sq_off.ring_mask);
+    sqFlags = (unsigned *)(ring + params.sq_off.flags);
+    sqArray = (unsigned *)(ring + params.sq_off.array);
+    sqEntries = params.sq_entries;
+    sqLocalTail = *sqTail;
+    cqHead  = (unsigned *)(ring + params.cq_off.head);
+    cqTail  = (unsigned *)(ring + params.cq_off.tail);
+    cqMask  = (unsigned *)(ring + params.cq_off.ring_mask);
+    cqes    = (io_uring_cqe *)(ring + params.cq_off.cqes);
+
+    bufRingSize = URING_RECV_BUFFERS * sizeof(io_uring_buf);
+    bufRing = (io_uring_buf_ring *)mapOrDie(bufRingSize, -1, 0);
+    auto bufReg = io_uring_buf_reg();
+    bufReg.ring_addr = (uint64_t)bufRing;
+    bufReg.ring_entries = URING_RECV_BUFFERS;
+    bufReg.bgid = URING_BUFFER_GROUP;
+    if (uringRegister(ringFd, IORING_REGISTER_PBUF_RING, &bufReg, 1) != 0) {
+        perror("UringTransport: IORING_REGISTER_PBUF_RING");
+        exit(1);
+    }
+    bufLocalTail = 0;
+    for (uint32_t bufferId = 0; bufferId < URING_RECV_BUFFERS; ++bufferId)
+        recycle(&bufArena[bufferId * URING_BUFFER_SIZE], bufferId);
+
+    // Neither source address nor control data, payload follows the header
+    memset(&recvHdr, 0, sizeof(recvHdr));
+    recvArmed = false;
+
+    for (uint32_t slot = sendSlots.size(); slot > 0; --slot)
+        freeSendSlots.push_back(slot - 1);
+}
+
+UringTransport::~UringTransport() {
+    // Buffers still in the inbox belong to the ring being torn down
+    while (!inQueue->empty())
+        inQueue->pop();
+    close(ringFd);
+    munmap(bufRing, bufRingSize);
+    munmap(sqes, sqesSize);
+    munmap(ringMem, ringMemSize);
+}
+
+/**
+ * Gives receive buffer back to the kernel
+ */
+void UringTransport::recycle(char *block, uint32_t bufferId) {
+    // Entries start at the ring base, the header flex array is offset in C++
+    auto *bufs = (io_uring_buf *)bufRing;
+    auto &buf = bufs[bufLocalTail & (URING_RECV_BUFFERS - 1)];
+    buf.addr = (uint64_t)block;
+    buf.len = URING_BUFFER_SIZE;
+    buf.bid = bufferId;
+    __atomic_store_n(&bufRing->tail, ++bufLocalTail, __ATOMIC_RELEASE);
+}
+
+io_uring_sqe* UringTransport::getSqe() {
+    auto head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    if (sqLocalTail - head >= sqEntries)
+        return nullptr;
+    auto index = sqLocalTail & *sqMask;
+    sqArray[index] = index;
+    sqLocalTail++;
+    auto *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+void UringTransport::prepareRecv() {
+    auto *sqe = getSqe();
+    if (sqe == nullptr)
+        return;
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = sock;
+    sqe->addr = (uint64_t)&recvHdr;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = URING_RECV_TAG;
+    recvArmed = true;
+}
+
+/**
+ * Moves batched datagrams to free send slots, each slot stays busy and
+ * holds its credit until the completion comes back.
+ */
+void UringTransport::prepareSends() {
+    size_t prepared = 0;
+    while (prepared < sendBatch.size() && !freeSendSlots.empty()) {
+        auto *sqe = getSqe();
+        if (sqe == nullptr)
+            break;
+
+        auto slotIdx = freeSendSlots.back();
+        freeSendSlots.pop_back();
+        auto &slot = sendSlots[slotIdx];
+        slot.datagram = move(sendBatch[prepared++]);
+        slot.addr = toSockAddr(slot.datagram.remote);
+        slot.iov = iovec { slot.datagram.payload.data(),
+                           slot.datagram.payload.size() };
+        memset(&slot.hdr, 0, sizeof(slot.hdr));
+        slot.hdr.msg_name = &slot.addr;
+        slot.hdr.msg_namelen = sizeof(sockaddr_in);
+        slot.hdr.msg_iov = &slot.iov;
+        slot.hdr.msg_iovlen = 1;
+
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = sock;
+        sqe->addr = (uint64_t)&slot.hdr;
+        sqe->len = 1;
+        sqe->user_data = slotIdx;
+    }
+    sendBatch.erase(sendBatch.begin(), sendBatch.begin() + prepared);
+}
+
+/**
+ * Single io_uring_enter submits everything prepared and runs pending task
+ * work, skipped when there is nothing to submit and no completion waits.
+ */
+void UringTransport::submitAndReap() {
+    auto toSubmit = sqLocalTail - *sqTail;
+    auto taskWork = __atomic_load_n(sqFlags, __ATOMIC_RELAXED)
+                    & IORING_SQ_TASKRUN;
+    if (toSubmit > 0 || taskWork) {
+        __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+        uringEnter(ringFd, toSubmit, 0, IORING_ENTER_GETEVENTS);
+        stats.syscalls++;
+    }
+    reapCompletions();
+}
+
+void UringTransport::reapCompletions() {
+    auto head = *cqHead;
+    auto tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        auto &cqe = cqes[head & *cqMask];
+        if (cqe.user_data == URING_RECV_TAG) {
+            handleRecv(cqe);
+            continue;
+        }
+        // Failed send is a lost datagram, like with sendmmsg
+        auto &slot = sendSlots[cqe.user_data];
+        releaseCredit(slot.datagram.remote);
+        slot.datagram.payload.reset();
+        freeSendSlots.push_back(cqe.user_data);
+    }
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+}
+
+void UringTransport::handleRecv(const io_uring_cqe &cqe) {
+    // Ran out of buffers or failed, armed again on next drain
+    if (!(cqe.flags & IORING_CQE_F_MORE))
+        recvArmed = false;
+    if (!(cqe.flags & IORING_CQE_F_BUFFER))
+        return;
+
+    auto bufferId = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+    auto *block = &bufArena[bufferId * URING_BUFFER_SIZE];
+    auto *out = (io_uring_recvmsg_out *)block;
+    if (cqe.res <= 0 || (out->flags & MSG_TRUNC)) {
+        recycle(block, bufferId);
+        return;
+    }
+    auto buffer = PooledBuffer(this, block, bufferId,
+                               block + sizeof(io_uring_recvmsg_out),
+                               out->payloadlen);
+    Queue::enqueue(inQueue, move(buffer));
+}
+
+bool UringTransport::drain() {
+    if (!recvArmed)
+        prepareRecv();
+    flush();
+    return true;
+}
+
+void UringTransport::flush() {
+    prepareSends();
+    submitAndReap();
+}
+
+} // namespace net
+
+#endif /* USE_IO_URING */
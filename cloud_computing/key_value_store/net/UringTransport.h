@@ -0,0 +1,77 @@
+#ifndef URINGTRANSPORT_H_
+#define URINGTRANSPORT_H_
+
+#ifdef USE_IO_URING
+
+#include "net/UdpTransport.h"
+
+#include <linux/io_uring.h>
+#include <vector>
+
+namespace net {
+
+/**
+ * Loopback UDP transport driven by io_uring. A single multishot recvmsg
+ * keeps receiving into a ring of kernel provided buffers, the buffers go up
+ * to the message queue as they are and return to the ring once the message
+ * is consumed. Sends are submitted as one batch of sendmsg requests, so a
+ * tick costs one io_uring_enter per node at most.
+ */
+class UringTransport : public UdpTransport, public BufferOwner {
+public:
+    UringTransport(Inbox *inQueue, Address address, uint16_t basePort,
+                   int sendWindow = DEFAULT_SEND_WINDOW);
+    ~UringTransport();
+
+    bool    drain() override;
+    void    flush() override;
+    void    recycle(char *block, uint32_t bufferId) override;
+
+private:
+    struct SendSlot {
+        Datagram        datagram;
+        sockaddr_in     addr;
+        iovec           iov;
+        msghdr          hdr;
+    };
+
+    io_uring_sqe*   getSqe();
+    void            prepareRecv();
+    void            prepareSends();
+    void            submitAndReap();
+    void            reapCompletions();
+    void            handleRecv(const io_uring_cqe &cqe);
+
+    int                     ringFd;
+    void                    *ringMem;
+    size_t                  ringMemSize;
+    io_uring_sqe            *sqes;
+    size_t                  sqesSize;
+    unsigned                *sqHead;
+    unsigned                *sqTail;
+    unsigned                *sqMask;
+    unsigned                *sqFlags;
+    unsigned                *sqArray;
+    unsigned                sqEntries;
+    unsigned                sqLocalTail;
+    unsigned                *cqHead;
+    unsigned                *cqTail;
+    unsigned                *cqMask;
+    io_uring_cqe            *cqes;
+
+    io_uring_buf_ring       *bufRing;
+    size_t                  bufRingSize;
+    std::vector<char>       bufArena;
+    unsigned                bufLocalTail;
+    bool                    recvArmed;
+    msghdr                  recvHdr;
+
+    std::vector<SendSlot>   sendSlots;
+    std::vector<uint32_t>   freeSendSlots;
+};
+
+} // namespace net
+
+#endif /* USE_IO_URING */
+
+#endif
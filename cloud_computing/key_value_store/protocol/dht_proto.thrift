@@ -13,7 +13,11 @@ enum ReqType {
     DELETE_RSP,
     UPDATE_RSP,
     SYNC_BEGIN,
-    SYNC_END
+    SYNC_END,
+    MULTI_GET,
+    MULTI_GET_RSP,
+    MULTI_PUT,
+    MULTI_PUT_RSP
 }
 
 enum ReqStatus {
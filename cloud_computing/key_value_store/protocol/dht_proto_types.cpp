@@ -23,7 +23,11 @@ int _kReqTypeValues[] = {
   ReqType::DELETE_RSP,
   ReqType::UPDATE_RSP,
   ReqType::SYNC_BEGIN,
-  ReqType::SYNC_END
+  ReqType::SYNC_END,
+  ReqType::MULTI_GET,
+  ReqType::MULTI_GET_RSP,
+  ReqType::MULTI_PUT,
+  ReqType::MULTI_PUT_RSP
 };
 const char* _kReqTypeNames[] = {
   "CREATE",
@@ -35,9 +39,13 @@ const char* _kReqTypeNames[] = {
   "DELETE_RSP",
   "UPDATE_RSP",
   "SYNC_BEGIN",
-  "SYNC_END"
+  "SYNC_END",
+  "MULTI_GET",
+  "MULTI_GET_RSP",
+  "MULTI_PUT",
+  "MULTI_PUT_RSP"
 };
-const std::map<int, const char*> _ReqType_VALUES_TO_NAMES(::apache::thrift::TEnumIterator(10, _kReqTypeValues, _kReqTypeNames), ::apache::thrift::TEnumIterator(-1, NULL, NULL));
+const std::map<int, const char*> _ReqType_VALUES_TO_NAMES(::apache::thrift::TEnumIterator(14, _kReqTypeValues, _kReqTypeNames), ::apache::thrift::TEnumIterator(-1, NULL, NULL));
 
 int _kReqStatusValues[] = {
   ReqStatus::OK,
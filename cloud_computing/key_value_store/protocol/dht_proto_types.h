@@ -30,7 +30,11 @@ struct ReqType {
     DELETE_RSP = 6,
     UPDATE_RSP = 7,
     SYNC_BEGIN = 8,
-    SYNC_END = 9
+    SYNC_END = 9,
+    MULTI_GET = 10,
+    MULTI_GET_RSP = 11,
+    MULTI_PUT = 12,
+    MULTI_PUT_RSP = 13
   };
 };
 
@@ -1,18 +1,23 @@
 #ifndef DHT_H_
 #define DHT_H_
 
+#include <map>
 #include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 #include "net/Address.h"
 #include "net/Message.h"
 #include "net/Transport.h"
+#include "service/Partitioner.h"
 #include "simulator/Member.h"
 
 class Log;
 
 using MembersList = std::vector<MemberListEntry>;
-using AddressList = std::vector<Address>;
+using KeyValueMap = std::map<std::string, std::string>;
 // using Message = dsproto::Message;
+using proto::dht::Header;
 using proto::dht::Message;
 using proto::dht::MessageQueue;
 
@@ -20,6 +25,8 @@ using proto::dht::MessageQueue;
 class MembershipServiceIface {
 public:
     virtual const AddressList& getMembersList() = 0;
+    // Changes whenever members join or leave the list, never goes back
+    virtual uint64_t getMembersVersion()        = 0;
     virtual Address getLocalAddress()           = 0;
 };
 using MembershipProxy = shared_ptr<MembershipServiceIface>;
@@ -34,8 +41,11 @@ public:
     virtual ~DHTBackend() = default;
     virtual AddressList getNaturalNodes(const string&)  = 0;
     virtual void updateCluster()                        = 0;
-    virtual bool probe(const Message &msg)              = 0;
+    // Message types the backend handles, asked once at start
+    virtual bool handles(int type)                      = 0;
     virtual void handle(Message &msg)                   = 0;
+    // True while some replica sync is not acknowledged yet
+    virtual bool hasPendingSyncs()                      = 0;
 };
 
 
@@ -51,9 +61,19 @@ public:
     virtual string read(const string &key)              = 0;
     virtual void   update(string &&key, string &&value) = 0;
     virtual void   remove(const string &key)            = 0;
-    virtual bool   probe(Message &msg)                  = 0;
+    // One message per natural node instead of one per key and replica,
+    // each key is logged as a read or create of its own
+    virtual void   multiGet(const vector<string> &keys) = 0;
+    virtual void   multiPut(KeyValueMap &&entries)      = 0;
+    // Message types the coordinator handles, asked once at start
+    virtual bool   handles(int type)                    = 0;
+    // False when the response comes too late to matter, its body is
+    // never decoded then
+    virtual bool   awaits(const Header &header)         = 0;
     virtual void   handle(Message &msg)                 = 0;
     virtual void   onClusterUpdate()                    = 0;
+    // True while some request waits for responses or its timeout
+    virtual bool   hasPendingCommands()                 = 0;
 };
 
 /******************************************************************************
@@ -62,22 +82,32 @@ public:
 class DistributedHashTableService {
 public:
     DistributedHashTableService(MembershipProxy membershipProxy,
-        shared_ptr<MessageQueue> msgQueue, Log *log);
+        shared_ptr<MessageQueue> msgQueue, const PartitionerOptions &partitionerOptions,
+        Log *log);
 
     void create(string &&key, string &&value);
     void read(const string &key);
     void update(string &&key, string &&value);
     void remove(const string &key);
+    void multiGet(const vector<string> &keys);
+    void multiPut(KeyValueMap &&entries);
     bool recieveMessages();
     bool processMessages();
     void updateCluster();
+    bool hasPendingWork();
     AddressList getNaturalNodes(const string &key);
 
 private:
+    enum class Route : uint8_t { DROP, BACKEND, COORDINATOR };
+
     shared_ptr<MessageQueue>    msgQueue;
     shared_ptr<DHTBackend>      backend;
     unique_ptr<DHTCoordinator>  coordinator;
     Log                         *log;
+    // Decoded messages of the last batch, reused by the next one
+    vector<Message>             inbox;
+    // Handler of every message type, indexed by ReqType
+    vector<Route>               routes;
 };
 
 #endif
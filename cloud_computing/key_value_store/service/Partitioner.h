@@ -0,0 +1,154 @@
+#ifndef PARTITIONER_H_
+#define PARTITIONER_H_
+
+#include "net/Address.h"
+#include "simulator/KeyHash.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class MembershipServiceIface;
+
+using AddressList = std::vector<Address>;
+
+enum class PartitionerKind {
+    RING,           // weighted tokens on a 64 bit ring
+    JUMP,           // jump consistent hash, replica sets tabled per node
+    RENDEZVOUS      // weighted highest random weight
+};
+
+// Tokens a node of weight 1 gets on the ring
+static const uint32_t DEFAULT_RING_TOKENS = 256;
+
+struct PartitionerOptions {
+    PartitionerKind kind = PartitionerKind::RING;
+    uint32_t tokensPerNode = DEFAULT_RING_TOKENS;
+    // Share of keys of a node scales with its weight, nodes not listed
+    // weigh 1. Indexed by node id, the ip of its address. JUMP places
+    // keys evenly and ignores weights.
+    std::unordered_map<int32_t, double> weights;
+};
+
+
+// Addresses held by someone else, valid while the holder is unchanged
+class AddressSpan {
+public:
+    AddressSpan() = default;
+    AddressSpan(const Address *first, size_t count)
+        : first(first), count(count) {}
+    AddressSpan(const AddressList &addrList)
+        : first(addrList.data()), count(addrList.size()) {}
+
+    const Address* begin() const { return first; }
+    const Address* end() const { return first + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const Address& operator[](size_t idx) const { return first[idx]; }
+
+private:
+    const Address *first = nullptr;
+    size_t         count = 0;
+};
+
+
+/**
+ * Placement of keys for one membership version. It is never changed once
+ * built, a new version gets a new placement, so holders of an old one can
+ * compare it with the current.
+ */
+class Placement {
+public:
+    Placement(uint64_t membersVersion, AddressList endpoints)
+        : membersVersion(membersVersion), endpoints(std::move(endpoints)) {}
+    virtual ~Placement() = default;
+
+    /**
+     * Distinct natural nodes of a key hash. Placements with a replica set
+     * table return a view into it, others write the set into scratch and
+     * view that, so a scratch list reused for many lookups keeps its
+     * memory. The view lives as long as both.
+     */
+    virtual AddressSpan getReplicaSet(uint64_t keyHash,
+                                      AddressList &scratch) const = 0;
+
+    // Replica sets of count key hashes, replicaSets[i] of keyHashes[i]
+    // with scratch[i]. Strategies that can overlap the lookups of a batch
+    // override it.
+    virtual void getReplicaSets(const uint64_t *keyHashes, size_t count,
+                                AddressSpan *replicaSets,
+                                AddressList *scratch) const {
+        for (size_t i = 0; i < count; ++i)
+            replicaSets[i] = getReplicaSet(keyHashes[i], scratch[i]);
+    }
+
+    const uint64_t      membersVersion;
+    const AddressList   endpoints;
+};
+
+
+/**
+ * Keeps the placement of the current membership. Backend and coordinator
+ * of a node share one partitioner, so a placement is built once per
+ * membership version for both. Strategies differ only in the placement
+ * they build.
+ */
+class Partitioner {
+public:
+    Partitioner(uint16_t replicationFactor, const PartitionerOptions &options)
+        : replicationFactor(replicationFactor), options(options) {}
+    virtual ~Partitioner() = default;
+
+    static std::shared_ptr<Partitioner> create(
+        uint16_t replicationFactor, const PartitionerOptions &options);
+
+    // Builds a new placement only when the membership changed since the
+    // last call, otherwise costs a version compare
+    void refresh(MembershipServiceIface &membership);
+
+    // Current placement, kept alive by holders when refresh() replaces it
+    std::shared_ptr<const Placement> getPlacement() {
+        return placement;
+    }
+
+    // Members the placement was built from, valid until the next refresh()
+    const AddressList& getEndpoints() {
+        return placement->endpoints;
+    }
+
+    uint16_t getReplicationFactor() {
+        return replicationFactor;
+    }
+
+    // Same on every node and build, unlike std::hash
+    uint64_t getKeyHash(const std::string &key) {
+        return hashKey(key);
+    }
+
+    AddressSpan getNaturalNodes(const std::string &key,
+                                AddressList &scratch) {
+        return placement->getReplicaSet(getKeyHash(key), scratch);
+    }
+
+    // For a block of keys hashed with hashBlocks()
+    void getNaturalNodes(const uint64_t *keyHashes, size_t count,
+                         AddressSpan *naturalNodes, AddressList *scratch) {
+        placement->getReplicaSets(keyHashes, count, naturalNodes, scratch);
+    }
+
+protected:
+    virtual std::shared_ptr<const Placement> build(
+        uint64_t membersVersion, const AddressList &members) = 0;
+
+    double getWeight(const Address &addr);
+
+    uint16_t            replicationFactor;
+    PartitionerOptions  options;
+
+private:
+    std::shared_ptr<const Placement> placement;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef TOKENTREE_H_
+#define TOKENTREE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Sorted 64 bit ring positions searched for the first one at or after a
+ * key, what lower_bound over them finds, wrapping to the first.
+ *
+ * Positions are kept in Eytzinger order, the implicit binary tree of a
+ * heap, in a cache line aligned array. The top levels of the tree share a
+ * few cache lines and every cache line a search loads holds its next 3
+ * levels, where lower_bound loads a new line nearly every step. The tree
+ * is padded to a full one so every search takes the same steps with no
+ * branches, and searches of a batch are interleaved to overlap their
+ * cache misses.
+ */
+class TokenTree {
+public:
+    TokenTree() = default;
+    // tree points into storage of this very tree
+    TokenTree(const TokenTree&)            = delete;
+    TokenTree& operator=(const TokenTree&) = delete;
+
+    void build(const std::vector<uint64_t> &sortedPositions) {
+        levels = 0;
+        while ((size_t(1) << levels) - 1 < sortedPositions.size())
+            ++levels;
+        auto slotsCount = size_t(1) << levels;
+        auto lineSlots = CACHE_LINE_SIZE / sizeof(uint64_t);
+        storage.assign(slotsCount + lineSlots, UINT64_MAX);
+        auto misalignment = uintptr_t(storage.data()) % CACHE_LINE_SIZE;
+        auto *slots = storage.data()
+                    + (CACHE_LINE_SIZE - misalignment) % CACHE_LINE_SIZE
+                      / sizeof(uint64_t);
+        ranks.assign(slotsCount, 0);
+        auto rank = size_t(0);
+        fill(1, slots, sortedPositions, rank);
+        tree = slots;
+    }
+
+    // Sorted rank of the first position at or after keyHash, wrapping to 0
+    uint32_t find(uint64_t keyHash) const {
+        auto slot = size_t(1);
+        for (size_t level = 0; level < levels; ++level) {
+            if (level + PREFETCH_LEVELS < levels)
+                prefetch(tree + (slot << PREFETCH_LEVELS));
+            slot = 2 * slot + (tree[slot] < keyHash);
+        }
+        return ranks[dropRightTurns(slot)];
+    }
+
+    // Ranks of count key hashes, the same find() gives one by one
+    void find(const uint64_t *keyHashes, size_t count,
+              uint32_t *foundRanks) const {
+        auto idx = size_t(0);
+        for (; idx + SEARCH_LANES <= count; idx += SEARCH_LANES) {
+            size_t slots[SEARCH_LANES];
+            for (size_t lane = 0; lane < SEARCH_LANES; ++lane)
+                slots[lane] = 1;
+            for (size_t level = 0; level < levels; ++level) {
+                for (size_t lane = 0; lane < SEARCH_LANES; ++lane) {
+                    auto slot = slots[lane];
+                    if (level + PREFETCH_LEVELS < levels)
+                        prefetch(tree + (slot << PREFETCH_LEVELS));
+                    slots[lane] = 2 * slot
+                                + (tree[slot] < keyHashes[idx + lane]);
+                }
+            }
+            for (size_t lane = 0; lane < SEARCH_LANES; ++lane)
+                foundRanks[idx + lane] = ranks[dropRightTurns(slots[lane])];
+        }
+        for (; idx < count; ++idx)
+            foundRanks[idx] = find(keyHashes[idx]);
+    }
+
+private:
+    static const size_t CACHE_LINE_SIZE = 64;
+    // Tree levels a prefetch runs ahead, the 8 slots 3 levels below a slot
+    // share its cache line
+    static const size_t PREFETCH_LEVELS = 3;
+    // Searches interleaved by a batch lookup
+    static const size_t SEARCH_LANES    = 8;
+
+    static void prefetch(const void *addr) {
+#ifdef __GNUC__
+        __builtin_prefetch(addr);
+#endif
+    }
+
+    // Drops the trailing ones of slot and the zero above them, the right
+    // turns the search took after the last slot not below the key
+    static size_t dropRightTurns(size_t slot) {
+#ifdef __GNUC__
+        return slot >> (__builtin_ctzll(~(unsigned long long)slot) + 1);
+#else
+        while (slot & 1)
+            slot >>= 1;
+        return slot >> 1;
+#endif
+    }
+
+    // In order walk of the tree hands out sorted positions, slots past the
+    // last position keep UINT64_MAX and wrap to the first one
+    void fill(size_t slot, uint64_t *slots,
+              const std::vector<uint64_t> &sortedPositions, size_t &rank) {
+        if (slot >= ranks.size())
+            return;
+        fill(2 * slot, slots, sortedPositions, rank);
+        if (rank < sortedPositions.size()) {
+            slots[slot] = sortedPositions[rank];
+            ranks[slot] = uint32_t(rank);
+        }
+        ++rank;
+        fill(2 * slot + 1, slots, sortedPositions, rank);
+    }
+
+    size_t                  levels = 0;         // steps of a search
+    std::vector<uint64_t>   storage;            // backs tree, aligned within
+    const uint64_t         *tree = nullptr;     // positions, root at 1
+    std::vector<uint32_t>   ranks;              // sorted rank of a slot
+};
+
+#endif
@@ -0,0 +1,332 @@
+#include "service/Partitioner.h"
+#include "service/DistributedHashTable.h"
+#include "service/TokenTree.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <utility>
+
+using namespace std;
+
+// Finalizer of splitmix64, spreads node hashes over 64 bits
+inline uint64_t mixNodeHash(uint64_t hash) {
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ull;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebull;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+inline uint64_t getNodeHash(const Address &addr) {
+    return mixNodeHash(((uint64_t)(uint32_t)addr.getIp() << 32)
+                       + (uint16_t)addr.getPort());
+}
+
+inline bool addressLess(const Address &a, const Address &b) {
+    return a.getIp() != b.getIp() ? a.getIp() < b.getIp()
+                                  : a.getPort() < b.getPort();
+}
+
+
+void Partitioner::refresh(MembershipServiceIface &membership) {
+    auto membersVersion = membership.getMembersVersion();
+    if (placement && placement->membersVersion == membersVersion)
+        return;
+    placement = build(membersVersion, membership.getMembersList());
+}
+
+double Partitioner::getWeight(const Address &addr) {
+    auto weightPos = options.weights.find(addr.getIp());
+    return weightPos != options.weights.end() ? weightPos->second : 1.0;
+}
+
+
+/******************************************************************************
+ * Ring - every node holds many tokens on a 64 bit ring, in proportion to its
+ * weight, so ranges stay close to even with few nodes
+ ******************************************************************************/
+
+// Token of a node, it owns keys from the token before up to pos
+struct RingToken {
+    uint64_t pos;
+    size_t   index;     // of the node in endpoints
+};
+
+bool operator<(const RingToken &a, const RingToken &b) {
+    return a.pos < b.pos;
+};
+
+/**
+ * Token positions are searched in a TokenTree apart from their owners. A
+ * search ends at the rank of a token, the range it closes. Replica sets
+ * of all ranges are laid out at a fixed stride in one table, so a lookup
+ * is a search and a view into the table, no ring walk and no copy.
+ */
+class RingPlacement : public Placement {
+public:
+    RingPlacement(uint64_t membersVersion, AddressList endpoints,
+                  uint16_t replicationFactor, vector<RingToken> &&tokens)
+        : Placement(membersVersion, move(endpoints)) {
+        sort(tokens.begin(), tokens.end());
+        fillReplicaTable(tokens, replicationFactor);
+        auto positions = vector<uint64_t>();
+        positions.reserve(tokens.size());
+        for (auto &token : tokens)
+            positions.push_back(token.pos);
+        tree.build(positions);
+    }
+
+    AddressSpan getReplicaSet(uint64_t keyHash,
+                              AddressList&) const override {
+        if (replicaTable.empty())
+            return AddressSpan();
+        return getRangeReplicas(tree.find(keyHash));
+    }
+
+    void getReplicaSets(const uint64_t *keyHashes, size_t count,
+                        AddressSpan *replicaSets,
+                        AddressList*) const override {
+        uint32_t ranks[KEY_HASH_BLOCK];
+        for (size_t first = 0; first < count; first += KEY_HASH_BLOCK) {
+            auto blockCount = min(KEY_HASH_BLOCK, count - first);
+            if (replicaTable.empty()) {
+                fill(replicaSets + first, replicaSets + first + blockCount,
+                     AddressSpan());
+                continue;
+            }
+            tree.find(keyHashes + first, blockCount, ranks);
+            for (size_t i = 0; i < blockCount; ++i)
+                replicaSets[first + i] = getRangeReplicas(ranks[i]);
+        }
+    }
+
+private:
+    AddressSpan getRangeReplicas(uint32_t rank) const {
+        return AddressSpan(&replicaTable[rank * replicasCount],
+                           replicasCount);
+    }
+
+    // Walks tokens clockwise from every rank, skipping nodes already taken.
+    // Every node has a token, so every range gets replicasCount nodes.
+    void fillReplicaTable(const vector<RingToken> &tokens,
+                          uint16_t replicationFactor) {
+        replicasCount = min(size_t(replicationFactor), endpoints.size());
+        replicaTable.reserve(tokens.size() * replicasCount);
+        auto naturalNodes = AddressList();
+        for (size_t rank = 0; rank < tokens.size(); ++rank) {
+            naturalNodes.clear();
+            for (auto token = rank; naturalNodes.size() < replicasCount; ) {
+                auto &endpoint = endpoints[tokens[token].index];
+                if (find(naturalNodes.begin(), naturalNodes.end(), endpoint)
+                        == naturalNodes.end()) {
+                    naturalNodes.push_back(endpoint);
+                }
+                if (++token == tokens.size())
+                    token = 0;
+            }
+            replicaTable.insert(replicaTable.end(), naturalNodes.begin(),
+                                naturalNodes.end());
+        }
+    }
+
+    TokenTree         tree;             // token positions
+    size_t            replicasCount = 0;
+    // Replica sets by sorted rank, replicasCount addresses each
+    AddressList       replicaTable;
+};
+
+class RingPartitioner : public Partitioner {
+public:
+    using Partitioner::Partitioner;
+
+protected:
+    shared_ptr<const Placement> build(uint64_t membersVersion,
+                                      const AddressList &members) override {
+        auto tokens = vector<RingToken>();
+        for (auto idx = 0ul; idx < members.size(); ++idx) {
+            auto &endpoint = members[idx];
+            auto tokensCount = getTokensCount(endpoint);
+            auto nodeHash = getNodeHash(endpoint);
+            for (auto token = 0u; token < tokensCount; ++token) {
+                auto pos = mixNodeHash(nodeHash + token);
+                tokens.push_back(RingToken{ pos, idx });
+            }
+        }
+        return make_shared<RingPlacement>(membersVersion, members,
+                                          replicationFactor, move(tokens));
+    }
+
+private:
+    // Every node gets at least one token
+    uint32_t getTokensCount(const Address &addr) {
+        auto tokens = lround(options.tokensPerNode * getWeight(addr));
+        return tokens > 0 ? uint32_t(tokens) : 1;
+    }
+};
+
+
+/******************************************************************************
+ * Jump consistent hash (Lamping, Veach) - nodes are numbered buckets, a key
+ * picks its bucket in O(log n) with no per node state. Here the replica
+ * sets of all buckets are tabled, O(n * RF) addresses, so a lookup returns
+ * a view like the ring does. That trades the O(1) memory of jump hash for
+ * lookups with no copy. Only the last bucket can be removed cheaply, a
+ * node leaving from the middle renumbers the ones after it and moves their
+ * keys. Weights are ignored.
+ ******************************************************************************/
+class JumpPlacement : public Placement {
+public:
+    JumpPlacement(uint64_t membersVersion, AddressList endpoints,
+                  uint16_t replicationFactor)
+        : Placement(membersVersion, move(endpoints)) {
+        auto bucketsCount = this->endpoints.size();
+        replicasCount = min(size_t(replicationFactor), bucketsCount);
+        for (size_t bucket = 0; bucket < bucketsCount; ++bucket) {
+            for (size_t i = 0; i < replicasCount; ++i) {
+                auto &endpoint = this->endpoints[(bucket + i) % bucketsCount];
+                replicaTable.push_back(endpoint);
+            }
+        }
+    }
+
+    // Replicas sit on the buckets following the one of the key, tabled
+    // per bucket
+    AddressSpan getReplicaSet(uint64_t keyHash,
+                              AddressList&) const override {
+        if (endpoints.empty())
+            return AddressSpan();
+        auto bucket = size_t(getBucket(keyHash, endpoints.size()));
+        return AddressSpan(&replicaTable[bucket * replicasCount],
+                           replicasCount);
+    }
+
+    static int64_t getBucket(uint64_t keyHash, size_t bucketsCount) {
+        int64_t bucket = -1, next = 0;
+        while (next < int64_t(bucketsCount)) {
+            bucket = next;
+            keyHash = keyHash * 2862933555777941757ull + 1;
+            next = int64_t((bucket + 1)
+                           * (double(1ll << 31) / double((keyHash >> 33) + 1)));
+        }
+        return bucket;
+    }
+
+    size_t      replicasCount = 0;
+    AddressList replicaTable;       // replicasCount addresses per bucket
+};
+
+class JumpPartitioner : public Partitioner {
+public:
+    using Partitioner::Partitioner;
+
+protected:
+    // Buckets are numbered in address order, the same on every node
+    // whatever order its membership list has
+    shared_ptr<const Placement> build(uint64_t membersVersion,
+                                      const AddressList &members) override {
+        auto endpoints = members;
+        sort(endpoints.begin(), endpoints.end(), addressLess);
+        return make_shared<JumpPlacement>(membersVersion, move(endpoints),
+                                          replicationFactor);
+    }
+};
+
+
+/******************************************************************************
+ * Rendezvous, highest random weight - every node scores every key, the top
+ * scores are its replicas. A node leaving moves only its own keys. Scores
+ * are weight / -ln(u), u uniform from the key and node hashes, so the share
+ * of keys of a node is in proportion to its weight.
+ ******************************************************************************/
+
+// Natural nodes of a key are ranked on the stack up to this replication
+// factor, on the heap above it
+static const size_t RENDEZVOUS_STACK_REPLICAS = 16;
+
+struct RankedNode {
+    double score;
+    size_t idx;     // in endpoints
+};
+
+class RendezvousPlacement : public Placement {
+public:
+    RendezvousPlacement(uint64_t membersVersion, AddressList endpoints,
+                        uint16_t replicationFactor)
+        : Placement(membersVersion, move(endpoints)),
+          replicationFactor(replicationFactor) {}
+
+    // Scores every node, O(n) per key, keeping the best in a sorted array.
+    // Sets are not bound to ranges and cannot be tabled, they go to scratch.
+    AddressSpan getReplicaSet(uint64_t keyHash,
+                              AddressList &scratch) const override {
+        scratch.clear();
+        auto wanted = min(size_t(replicationFactor), endpoints.size());
+        RankedNode stackTop[RENDEZVOUS_STACK_REPLICAS];
+        auto heapTop = vector<RankedNode>();
+        auto *top = stackTop;
+        if (wanted > RENDEZVOUS_STACK_REPLICAS) {
+            heapTop.resize(wanted);
+            top = heapTop.data();
+        }
+        auto topCount = size_t(0);
+
+        for (size_t idx = 0; idx < endpoints.size(); ++idx) {
+            auto score = getScore(keyHash, idx);
+            if (topCount == wanted && score <= top[topCount - 1].score)
+                continue;
+            auto pos = topCount < wanted ? topCount++ : topCount - 1;
+            for (; pos > 0 && top[pos - 1].score < score; --pos)
+                top[pos] = top[pos - 1];
+            top[pos] = RankedNode{ score, idx };
+        }
+        for (size_t i = 0; i < topCount; ++i)
+            scratch.push_back(endpoints[top[i].idx]);
+        return AddressSpan(scratch);
+    }
+
+    double getScore(uint64_t keyHash, size_t idx) const {
+        auto hash = mixNodeHash(keyHash ^ nodeHashes[idx]);
+        // Top 53 bits as a double in (0, 1), never 0 or 1
+        auto uniform = (double(hash >> 11) + 0.5) * (1.0 / double(1ull << 53));
+        return weights[idx] / -log(uniform);
+    }
+
+    uint16_t         replicationFactor;
+    vector<uint64_t> nodeHashes;    // by index in endpoints
+    vector<double>   weights;
+};
+
+class RendezvousPartitioner : public Partitioner {
+public:
+    using Partitioner::Partitioner;
+
+protected:
+    // Nodes of no weight never hold keys, unlike on the ring, so weights
+    // are kept positive
+    shared_ptr<const Placement> build(uint64_t membersVersion,
+                                      const AddressList &members) override {
+        auto next = make_shared<RendezvousPlacement>(membersVersion, members,
+                                                     replicationFactor);
+        for (auto &endpoint : next->endpoints) {
+            next->nodeHashes.push_back(getNodeHash(endpoint));
+            next->weights.push_back(max(getWeight(endpoint), 1e-6));
+        }
+        return next;
+    }
+};
+
+
+shared_ptr<Partitioner> Partitioner::create(
+        uint16_t replicationFactor, const PartitionerOptions &options) {
+    switch (options.kind) {
+    case PartitionerKind::JUMP:
+        return make_shared<JumpPartitioner>(replicationFactor, options);
+    case PartitionerKind::RENDEZVOUS:
+        return make_shared<RendezvousPartitioner>(replicationFactor, options);
+    case PartitionerKind::RING:
+    default:
+        return make_shared<RingPartitioner>(replicationFactor, options);
+    }
+}
@@ -1,11 +1,15 @@
 #include "DistributedHashTable.h"
 
+#include "simulator/KeyHash.h"
 #include "simulator/Log.h"
 #include "net/Message.h"
 #include "net/Transport.h"
 
 #include <algorithm>
-#include <set>
+#include <cerrno>
+#include <cmath>
+#include <deque>
+#include <functional>
 #include <memory>
 #include <utility>
 #include <unordered_map>
@@ -20,143 +24,17 @@ auto getSrcEndpoint(const Message msg) -> Address {
         msg.header.srcPort);
 }
 
-using AddressList = vector<Address>;
-
-struct RingNode {
-    uint64_t rangeBegin;
-    uint64_t rangeEnd;
-    size_t   index;
-};
-
-bool operator<(const RingNode &a, const RingNode &b) {
-    return a.rangeEnd < b.rangeEnd;
-};
-
-
-class RingPartitioner {
-    uint16_t replicationFactor;
-    uint64_t ringSize;
-    vector<RingNode> ring;
-
-public:
-    RingPartitioner(uint16_t replicationFactor, uint64_t ringSize) {
-        this->replicationFactor = replicationFactor;
-        this->ringSize = ringSize;
-    }
-
-    uint16_t getReplicationFactor() {
-        return replicationFactor;
-    }
-
-    uint64_t getRingPos(const Address &addr) {
-        uint64_t hash = ((int64_t)addr.getIp() << 32) + addr.getPort();
-        hash = (hash * 2654435761ul) >> 32;
-        return hash % (ringSize);
-    }
-
-    uint64_t getRingPos(const string &key) {
-        static std::hash<string> hashString;
-        uint64_t hash = (hashString(key) * 2654435761ul) >> 32;
-        return hash % (ringSize);
-    }
-
-    using ReplicaSet = tuple<vector<RingNode>, size_t>;
-
-    // Returns replica set centered around addr
-    ReplicaSet getReplicaSet(const Address &addr) {
-        auto addrRingNode = RingNode{ 0, getRingPos(addr), 0 };
-        auto addrRingNodeIter = lower_bound(ring.cbegin(), ring.cend(), addrRingNode);
-        auto first = addrRingNodeIter;
-        auto last = addrRingNodeIter;
-        assert(first != ring.end());
-
-        for (auto sibling = 1ul; sibling < replicationFactor; ++sibling) {
-            if (previous(first) == last) {
-                break;
-            }
-            first = previous(first);
-            if (first == next(last)) {
-                break;
-            }
-            last = next(last);
-        }
-
-        vector<RingNode> replicaNodes;
-        replicaNodes.reserve(replicationFactor*2);
-        auto replicatorIdx = 0ul;
-        while (true) {
-            replicaNodes.push_back(*first);
-            if (first == addrRingNodeIter) {
-                replicatorIdx = replicaNodes.size() - 1;
-            }
-            if (first == last) {
-                break;
-            }
-            first = next(first);
-        }
-
-        return tie(replicaNodes, replicatorIdx);
-    }
-
-    template<typename Iter>
-    Iter next(Iter iter) {
-        ++iter;
-        if (iter == ring.end())
-            iter = ring.begin();
-        return iter;
-    }
-
-    template<typename Iter>
-    Iter previous(Iter iter) {
-        if (iter == ring.begin())
-            iter = ring.end();
-        return --iter;
-    }
-
-    AddressList getNaturalNodes(const string &key, const AddressList &endpoints) {
-        return getNaturalNodes(getRingPos(key), endpoints);
-    }
-
-    AddressList getNaturalNodes(const Address &addr, const AddressList &endpoints) {
-        return getNaturalNodes(getRingPos(addr), endpoints);
-    }
-
-    void updateRing(const AddressList &endpoints) {
-        assert(endpoints.size() > 0);
-        ring.resize(endpoints.size());
-        for (auto idx = 0ul; idx < endpoints.size(); ++idx) {
-            auto ringPos = getRingPos(endpoints[idx]);
-            ring[idx].rangeEnd = ringPos;
-            ring[idx].index = idx;
-        }
-        sort(ring.begin(), ring.end());
-        for (auto idx = 0ul; idx < endpoints.size(); ++idx) {
-            auto nextIdx = (idx + 1) % ring.size();
-            ring[nextIdx].rangeBegin = ring[idx].rangeEnd;
-        }
-    }
-
-    AddressList getNaturalNodes(uint64_t ringPos, const AddressList &endpoints) {
-        if (endpoints.size() == 0)
-            return AddressList();
-
-        // Find natural nodes (replica nodes) for key
-        auto naturalNodes = AddressList();
-        naturalNodes.reserve(replicationFactor);
-
-        auto wantedNode = RingNode{ 0, /*.rangeEnd=*/ringPos, 0};
-        auto startNode = lower_bound(ring.cbegin(), ring.cend(), wantedNode);
-        auto node = startNode;
-        do {
-            if (node == ring.end())
-                node = ring.begin();
-            naturalNodes.push_back(endpoints[node->index]);
-        } while (naturalNodes.size() < replicationFactor && ++node != startNode);
-
-        return naturalNodes;
-    }
-};
-
+// Estimated bytes of map entries per message of a sync or multi key
+// request, at most half of a payload
+static const size_t   BATCH_BYTES         = 2048;
+// Worst case framing of a map entry, two 32 bit varint lengths
+static const size_t   MAP_ENTRY_OVERHEAD  = 10;
+// Chunks of a stream in flight at once
+static const size_t   SYNC_WINDOW         = 4;
+// Ticks before an unacknowledged chunk is sent again
+static const uint32_t SYNC_TIMEOUT        = 5;
+// Resends of a chunk before its stream is given up
+static const uint32_t SYNC_MAX_RESENDS    = 5;
 
 /******************************************************************************
  * Commands
@@ -167,6 +45,7 @@ public:
         Address address;
         bool failed;
         bool responded;
+        bool sent;
         Message rsp;
     };
 
@@ -174,6 +53,8 @@ private:
     vector<EndpointEntry> endpoints;
     vector<Message>       endpoinsRsp;
     Message  req;
+    // Request as sent, kept until every endpoint got it
+    PooledBuffer encodedReq;
     uint16_t rspCount           = 0;
     uint16_t failRspCount       = 0;
     uint16_t successRspCount    = 0;
@@ -183,10 +64,10 @@ private:
 
 public:
     Command() {};
-    Command(vector<Address> &&addrList, Message &&msg) : req(move(msg)) {
+    Command(AddressSpan addrList, Message &&msg) : req(move(msg)) {
         endpoints.reserve(addrList.size());
         for (auto address : addrList) {
-            endpoints.push_back(EndpointEntry{ move(address), false, false, Message() });
+            endpoints.push_back(EndpointEntry{ move(address), false, false, false, Message() });
         }
     }
 
@@ -198,10 +79,33 @@ public:
         return endpoints;
     }
 
-    void multicast(shared_ptr<MessageQueue> msgQueue) {
+    // Sends the request to endpoints that did not get it yet. Returns false
+    // when some links were throttled and multicast has to be retried.
+    // Request is serialized once and all endpoints share the bytes.
+    bool multicast(shared_ptr<MessageQueue> msgQueue) {
+        auto allSent = true;
+        if (encodedReq.empty())
+            encodedReq = msgQueue->encode(req);
         for (auto &remote : endpoints) {
-            msgQueue->send(remote.address, req);
+            if (remote.sent)
+                continue;
+            auto result = msgQueue->send(remote.address, encodedReq);
+            if (result == -EAGAIN) {
+                allSent = false;
+                continue;
+            }
+            remote.sent = true;
+            if (result < 0) {
+                // Never deliverable, count it as a failed replica
+                remote.responded = true;
+                remote.failed = true;
+                rspCount++;
+                failRspCount++;
+            }
         }
+        if (allSent)
+            encodedReq.reset();
+        return allSent;
     }
 
     void addResponse(Message rsp) {
@@ -282,6 +186,208 @@ public:
 };
 
 
+/**
+ * Multi key request. Keys are grouped by the natural nodes that store
+ * them, every node gets its keys in one message, or in a few when they
+ * exceed BATCH_BYTES. Message seqId is its index in batches. A node
+ * answers with the keys it served, keys left out of the response failed
+ * on that node. Values read may not fit one response, so a response may
+ * answer only the keys from its body.key to its body.value, and the batch
+ * is answered once all its keys are. Each key completes on its own once a
+ * quorum of its natural nodes agrees.
+ */
+class MultiCommand {
+public:
+    struct KeyEntry {
+        uint16_t endpointsCount  = 0;
+        uint16_t successRspCount = 0;
+        uint16_t failRspCount    = 0;
+        bool     finished        = false;
+        string   value;             // put value, or first value read
+    };
+
+private:
+    struct Batch {
+        Address address;
+        Message req;
+        size_t  size;
+        bool    sent;
+        bool    responded;
+        size_t  answered;       // keys the responses so far answered
+        vector<string> parts;   // first keys of the responses so far
+    };
+
+    Message                         reqTemplate;
+    unordered_map<string, KeyEntry> keys;
+    vector<Batch>                   batches;
+    // Batch still taking keys of every endpoint
+    unordered_map<Address, size_t>  openBatches;
+    size_t   finishedCount = 0;
+    uint32_t timeout       = 10;
+
+public:
+    MultiCommand() {};
+    MultiCommand(Message &&reqTemplate) : reqTemplate(move(reqTemplate)) {}
+
+    // Value goes to the endpoints only with puts, reads send empty values
+    void addKey(const string &key, string &&value,
+                AddressSpan endpoints, size_t budget) {
+        auto &entry = keys[key];
+        entry.endpointsCount = endpoints.size();
+        auto isPut = reqTemplate.header.type == ReqType::MULTI_PUT;
+        auto entrySize = key.size() + MAP_ENTRY_OVERHEAD
+                       + (isPut ? value.size() : 0);
+
+        for (auto &address : endpoints) {
+            auto &batch = openBatch(address, entrySize, budget);
+            batch.req.body.keyValueMap.emplace(key,
+                                               isPut ? value : string());
+            batch.size += entrySize;
+        }
+        if (isPut)
+            entry.value = move(value);
+    }
+
+    // Sends batches that did not leave yet, false when some links were
+    // throttled and multicast has to be retried. A batch that can never
+    // be delivered fails its keys on that endpoint.
+    template <typename OnKeyDone>
+    bool multicast(shared_ptr<MessageQueue> msgQueue, OnKeyDone onKeyDone) {
+        auto allSent = true;
+        for (auto &batch : batches) {
+            if (batch.sent)
+                continue;
+            auto result = msgQueue->send(batch.address, batch.req);
+            if (result == -EAGAIN) {
+                allSent = false;
+                continue;
+            }
+            batch.sent = true;
+            if (result < 0) {
+                batch.responded = true;
+                for (auto &kv : batch.req.body.keyValueMap)
+                    addKeyResponse(kv.first, nullptr, onKeyDone);
+            }
+        }
+        return allSent;
+    }
+
+    // Calls onKeyDone(key, entry) for every key the response completes.
+    // A response without a key range answers the whole batch.
+    template <typename OnKeyDone>
+    void addResponse(const Message &rsp, OnKeyDone onKeyDone) {
+        auto batchIdx = size_t(rsp.header.seqId);
+        if (!(batchIdx < batches.size()))
+            return;
+        auto &batch = batches[batchIdx];
+        if (batch.responded || !(batch.address == getSrcEndpoint(rsp)))
+            return;
+        auto &first = rsp.body.key;
+        if (find(batch.parts.begin(), batch.parts.end(), first)
+                != batch.parts.end()) {
+            return;
+        }
+        batch.parts.push_back(first);
+
+        auto &requested = batch.req.body.keyValueMap;
+        auto rangeBegin = requested.begin();
+        auto rangeEnd = requested.end();
+        if (!first.empty() || !rsp.body.value.empty()) {
+            rangeBegin = requested.lower_bound(first);
+            rangeEnd = requested.upper_bound(rsp.body.value);
+        }
+        auto &served = rsp.body.keyValueMap;
+        for (auto kv = rangeBegin; kv != rangeEnd; ++kv) {
+            auto servedPos = served.find(kv->first);
+            auto *value = servedPos != served.end() ? &servedPos->second
+                                                    : nullptr;
+            addKeyResponse(kv->first, value, onKeyDone);
+            batch.answered++;
+        }
+        if (batch.answered >= requested.size())
+            batch.responded = true;
+    }
+
+    // Calls onKeyDone(key, entry) for keys still waiting for a quorum
+    template <typename OnKeyDone>
+    void finish(OnKeyDone onKeyDone) {
+        for (auto &kv : keys) {
+            if (kv.second.finished)
+                continue;
+            kv.second.finished = true;
+            onKeyDone(kv.first, kv.second);
+        }
+        finishedCount = keys.size();
+    }
+
+    bool hasFinished() {
+        return finishedCount == keys.size();
+    }
+
+    const Message& getRequest() {
+        return reqTemplate;
+    }
+
+    size_t getBatchesCount() {
+        return batches.size();
+    }
+
+    void updateTimeLeft() {
+        if (timeout == 0)
+            return;
+        timeout--;
+    }
+
+    uint32_t getTimeLeft() {
+        return timeout;
+    }
+
+private:
+    Batch& openBatch(const Address &address, size_t entrySize,
+                     size_t budget) {
+        auto openPos = openBatches.find(address);
+        if (openPos != openBatches.end()) {
+            auto &batch = batches[openPos->second];
+            if (batch.size + entrySize <= budget || batch.size == 0)
+                return batch;
+        }
+        openBatches[address] = batches.size();
+        batches.push_back(Batch{ address, reqTemplate, 0, false, false, 0,
+                                 vector<string>() });
+        batches.back().req.header.seqId = int32_t(batches.size() - 1);
+        return batches.back();
+    }
+
+    // Value is null when the endpoint failed the key
+    template <typename OnKeyDone>
+    void addKeyResponse(const string &key, const string *value,
+                        OnKeyDone onKeyDone) {
+        auto keyPos = keys.find(key);
+        if (keyPos == keys.end())
+            return;
+        auto &entry = keyPos->second;
+        if (entry.finished)
+            return;
+
+        if (value != nullptr) {
+            if (entry.successRspCount++ == 0
+                    && reqTemplate.header.type == ReqType::MULTI_GET) {
+                entry.value = *value;
+            }
+        } else {
+            entry.failRspCount++;
+        }
+        auto quorumMin = entry.endpointsCount/2 + 1;
+        if (entry.successRspCount >= quorumMin
+                || entry.failRspCount >= quorumMin) {
+            entry.finished = true;
+            finishedCount++;
+            onKeyDone(key, entry);
+        }
+    }
+};
+
+
 class CommandLogger {
     Log *log;
     Address localAddr;
@@ -337,90 +443,173 @@ public:
             break;
         }
     }
+
+    // Keys of a multi key request are logged one by one, as creates and
+    // reads of a single key are
+    void logKeySuccess(const Message &req, const string &key, const string &value) {
+        if (log == nullptr)
+            return;
+
+        switch (req.header.type) {
+        case ReqType::MULTI_PUT:
+            log->logCreateSuccess(&localAddr, isCoordinator, req.header.transaction, key, value);
+            break;
+        case ReqType::MULTI_GET:
+            log->logReadSuccess(&localAddr, isCoordinator, req.header.transaction, key, value);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void logKeyFailure(const Message &req, const string &key, const string &value) {
+        if (log == nullptr)
+            return;
+
+        switch (req.header.type) {
+        case ReqType::MULTI_PUT:
+            log->logCreateFail(&localAddr, isCoordinator, req.header.transaction, key, value);
+            break;
+        case ReqType::MULTI_GET:
+            log->logReadFail(&localAddr, isCoordinator, req.header.transaction, key);
+            break;
+        default:
+            break;
+        }
+    }
 };
 
 
 class RingDHTBackend : public DHTBackend {
+    // Keys [begin, end) of a stream, sent with seqId
+    struct SyncChunk {
+        size_t      begin;
+        size_t      end;
+        int32_t     seqId;
+        uint32_t    sentAt;
+        uint32_t    resends;
+        bool        acked;
+    };
+
+    // Replica sync: SYNC_BEGIN carries a chunk of entries, the replica
+    // acknowledges it with SYNC_END. Transaction of both is the stream id,
+    // seqId the chunk number. One stream runs per replica, keys of a later
+    // sync to it join the running stream.
+    struct SyncStream {
+        Address             remote;
+        vector<string>      keys;
+        size_t              cursor      = 0;    // first key not sent yet
+        int32_t             nextSeqId   = 0;
+        deque<SyncChunk>    inflight;
+    };
+
 public:
     RingDHTBackend(shared_ptr<MessageQueue> msgQueue,
                    MembershipProxy membershipProxy,
-                   size_t replicationFactor, Log *log)
-        : partitioner(replicationFactor, RING_SIZE),
+                   shared_ptr<Partitioner> partitioner, Log *log)
+        : partitioner(move(partitioner)),
           requestsLoger(log, membershipProxy->getLocalAddress(), false) {
         this->thisNodeAddr = membershipProxy->getLocalAddress();
         this->membershipProxy = move(membershipProxy);
         this->msgQueue = msgQueue;
+        this->msgQueue->onWritable([this](const Address &remote) {
+            resumeDeferred(remote);
+        });
     }
 
     virtual ~RingDHTBackend() = default;
 
     AddressList getNaturalNodes(const string &key) override {
-        auto members = membershipProxy->getMembersList();
-        partitioner.updateRing(members);
-        return partitioner.getNaturalNodes(key, members);
+        partitioner->refresh(*membershipProxy);
+        auto scratch = AddressList();
+        auto naturalNodes = partitioner->getNaturalNodes(key, scratch);
+        return AddressList(naturalNodes.begin(), naturalNodes.end());
     }
 
     void updateCluster() override {
-        auto members = membershipProxy->getMembersList();
-        if (members.size() <= 1) {
-            return;
-        }
-
-        //TODO this is inefficent, implement listener callbacks on members and timestamp
-        partitioner.updateRing(members);
+        syncTick++;
+        resendExpiredChunks();
 
-        auto naturalNodes = partitioner.getNaturalNodes(thisNodeAddr, members);
-        assert(naturalNodes.size() > 1 && naturalNodes[0] == thisNodeAddr);
-
-        if (nextNodeAddr == naturalNodes[1]) {
+        auto previous = partitioner->getPlacement();
+        partitioner->refresh(*membershipProxy);
+        auto current = partitioner->getPlacement();
+        if (current == previous || previous == nullptr)
             return;
-        }
-        nextNodeAddr = naturalNodes[1];
-
-        if (hashTable.size() == 0)
+        if (current->endpoints.size() <= 1 || hashTable.size() == 0)
             return;
-
-        auto replicaNodes = vector<RingNode>();
-        auto replicatorIdx = size_t(0);
-        tie(replicaNodes, replicatorIdx) = partitioner.getReplicaSet(thisNodeAddr);
-        sync(replicaNodes, replicatorIdx);
+        sync(*previous, *current);
     }
 
-    void sync(const vector<RingNode> replicaNodes, size_t replicatorIdx) {
-        if (!(replicatorIdx < replicaNodes.size())) {
-            return;
-        }
-        auto msgTemplate = createMessage(ReqType::SYNC_BEGIN);
-        msgTemplate.header.transaction = ++transaction;
-        auto syncMsgs = vector<Message>(replicaNodes.size() - replicatorIdx - 1,
-                                        msgTemplate);
-
-        for (auto &kv : hashTable) {
-            auto &key = kv.first;
-            auto &value  = kv.second;
-            auto ringPos = partitioner.getRingPos(key);
-
-            for (auto i = 0ul; i < syncMsgs.size(); ++i) {
-                if (ringPos > replicaNodes[i].rangeBegin ||
-                    replicaNodes[i].rangeEnd < replicaNodes[i].rangeBegin) {
-                    syncMsgs[i].body.keyValueMap[key] = value;
+    /**
+     * Streams every key to the nodes that became its replicas with the new
+     * placement. Of the old replicas still holding a key, only the first in the
+     * new order sends it. When none is left this node sends it.
+     */
+    void sync(const Placement &previous, const Placement &current) {
+        AddressSpan oldNodes[KEY_HASH_BLOCK];
+        AddressSpan newNodes[KEY_HASH_BLOCK];
+        AddressList oldScratch[KEY_HASH_BLOCK];
+        AddressList newScratch[KEY_HASH_BLOCK];
+        auto streamKeys = unordered_map<Address, vector<string>>();
+
+        auto keyOf = [](const HashTable::value_type &kv) -> const string& {
+            return kv.first;
+        };
+        hashBlocks(hashTable.begin(), hashTable.end(), keyOf,
+                   [&](const HashTable::iterator *items,
+                       const uint64_t *keyHashes, size_t count) {
+            previous.getReplicaSets(keyHashes, count, oldNodes, oldScratch);
+            current.getReplicaSets(keyHashes, count, newNodes, newScratch);
+
+            for (size_t i = 0; i < count; ++i) {
+                auto &old = oldNodes[i];
+                auto isOld = [&old](const Address &node) {
+                    return find(old.begin(), old.end(), node) != old.end();
+                };
+                auto sender = find_if(newNodes[i].begin(), newNodes[i].end(),
+                                      isOld);
+                if (sender != newNodes[i].end() && !(*sender == thisNodeAddr))
+                    continue;
+
+                for (auto &node : newNodes[i]) {
+                    if (!isOld(node) && !(node == thisNodeAddr))
+                        streamKeys[node].push_back(items[i]->first);
                 }
             }
+        });
+
+        for (auto &remoteKeys : streamKeys)
+            streamTo(remoteKeys.first, move(remoteKeys.second));
+    }
+
+    // Keys join the stream still running to remote, or start a new one.
+    // Keys are snapshotted, values are read as chunks leave.
+    void streamTo(const Address &remote, vector<string> &&keys) {
+        auto streamPos = find_if(syncStreams.begin(), syncStreams.end(),
+            [&remote](const pair<const uint32_t, SyncStream> &stream) {
+                return stream.second.remote == remote;
+            });
+        if (streamPos == syncStreams.end()) {
+            auto streamId = uint32_t(++transaction);
+            streamPos = syncStreams.emplace(streamId, SyncStream()).first;
+            streamPos->second.remote = remote;
         }
-        // TODO again calling getMembersList??
-        auto members = membershipProxy->getMembersList();
-        for (auto i = 0ul; i < syncMsgs.size(); ++i) {
-            msgQueue->send(members[replicaNodes[replicatorIdx + 1 + i].index],
-                            syncMsgs[i]);
-        }
+        auto &stream = streamPos->second;
+        stream.keys.insert(stream.keys.end(),
+                           make_move_iterator(keys.begin()),
+                           make_move_iterator(keys.end()));
+        pumpSync(streamPos->first, stream);
     }
 
-    bool probe(const Message &msg) override {
-        static auto msgTypes = set<uint8_t>{
-            ReqType::CREATE, ReqType::READ, ReqType::UPDATE, ReqType::DELETE,
-            ReqType::SYNC_BEGIN
-        };
-        return msgTypes.count(msg.header.type) > 0;
+    bool hasPendingSyncs() override {
+        return !syncStreams.empty();
+    }
+
+    bool handles(int type) override {
+        return type == ReqType::CREATE || type == ReqType::READ
+            || type == ReqType::UPDATE || type == ReqType::DELETE
+            || type == ReqType::SYNC_BEGIN || type == ReqType::SYNC_END
+            || type == ReqType::MULTI_GET || type == ReqType::MULTI_PUT;
     }
 
     void handle(Message &msg) override {
@@ -434,6 +623,12 @@ public:
             handleDeleteRequest(msg);
         } else if (msg.header.type == ReqType::SYNC_BEGIN) {
             handleSync(msg);
+        } else if (msg.header.type == ReqType::SYNC_END) {
+            handleSyncAck(msg);
+        } else if (msg.header.type == ReqType::MULTI_GET) {
+            handleMultiGetRequest(msg);
+        } else if (msg.header.type == ReqType::MULTI_PUT) {
+            handleMultiPutRequest(msg);
         }
     }
 
@@ -451,7 +646,7 @@ public:
             rsp.header.status = ReqStatus::OK;
         }
 
-        msgQueue->send(getSrcEndpoint(req), rsp);
+        post(getSrcEndpoint(req), move(rsp));
     }
 
     void hadleReadRequest(Message &req) {
@@ -468,7 +663,7 @@ public:
             rsp.header.status = ReqStatus::FAIL;
             requestsLoger.logFailure(req);
         }
-        msgQueue->send(getSrcEndpoint(req), rsp);
+        post(getSrcEndpoint(req), move(rsp));
     }
 
     void handleUpdateRequest(Message &req) {
@@ -485,7 +680,7 @@ public:
             requestsLoger.logFailure(req);
             rsp.header.status = ReqStatus::FAIL ;
         }
-        msgQueue->send(getSrcEndpoint(req), rsp);
+        post(getSrcEndpoint(req), move(rsp));
     }
 
     void handleDeleteRequest(Message &req) {
@@ -501,12 +696,193 @@ public:
             hashTable.erase(req.body.key);
             rsp.header.status = ReqStatus::OK;
         }
-        msgQueue->send(getSrcEndpoint(req), rsp);
+        post(getSrcEndpoint(req), move(rsp));
+    }
+
+    // Response carries only the keys found. Values of a batch may be far
+    // larger than its keys, so the response is split into parts of up to
+    // BATCH_BYTES, each answering the requested keys from its body.key to
+    // its body.value. A value too large for any part fails its key.
+    void handleMultiGetRequest(Message &req) {
+        auto remote = getSrcEndpoint(req);
+        auto budget = min(BATCH_BYTES, msgQueue->getMaxPayload() / 2);
+        auto rsp = createMultiGetPart(req);
+        auto used = size_t(0);
+        auto covered = size_t(0);
+
+        for (auto &kv : req.body.keyValueMap) {
+            auto valueIterator = hashTable.find(kv.first);
+            auto entrySize = valueIterator == hashTable.end() ? 0
+                           : kv.first.size() + valueIterator->second.size()
+                             + MAP_ENTRY_OVERHEAD;
+            if (entrySize > budget)
+                entrySize = 0;
+            if (entrySize > 0 && used + entrySize > budget) {
+                post(remote, move(rsp));
+                rsp = createMultiGetPart(req);
+                used = 0;
+                covered = 0;
+            }
+            if (covered++ == 0)
+                rsp.body.key = kv.first;
+            rsp.body.value = kv.first;
+
+            if (entrySize > 0) {
+                requestsLoger.logKeySuccess(req, kv.first, valueIterator->second);
+                auto &found = rsp.body.keyValueMap;
+                found.emplace_hint(found.end(), kv.first, valueIterator->second);
+                used += entrySize;
+            } else {
+                requestsLoger.logKeyFailure(req, kv.first, kv.second);
+            }
+        }
+        post(remote, move(rsp));
+    }
+
+    Message createMultiGetPart(const Message &req) {
+        auto rsp = createMessage(ReqType::MULTI_GET_RSP);
+        rsp.header.transaction = req.header.transaction;
+        rsp.header.seqId = req.header.seqId;
+        rsp.header.status = ReqStatus::OK;
+        return rsp;
+    }
+
+    // Keys are created as by CREATE, response carries the keys created
+    void handleMultiPutRequest(Message &req) {
+        auto rsp = createMessage(ReqType::MULTI_PUT_RSP);
+        rsp.header.transaction = req.header.transaction;
+        rsp.header.seqId = req.header.seqId;
+        rsp.header.status = ReqStatus::OK;
+
+        auto &created = rsp.body.keyValueMap;
+        for (auto &kv : req.body.keyValueMap) {
+            if (hashTable.count(kv.first)) {
+                requestsLoger.logKeyFailure(req, kv.first, kv.second);
+            } else {
+                requestsLoger.logKeySuccess(req, kv.first, kv.second);
+                hashTable[kv.first] = move(kv.second);
+                created.emplace_hint(created.end(), kv.first, string());
+            }
+        }
+        post(getSrcEndpoint(req), move(rsp));
     }
 
+    // Chunks may come twice or out of order, applying one is idempotent
     void handleSync(Message &msg) {
         hashTable.insert(msg.body.keyValueMap.begin(),
                          msg.body.keyValueMap.end());
+
+        auto ack = createMessage(ReqType::SYNC_END);
+        ack.header.transaction = msg.header.transaction;
+        ack.header.seqId = msg.header.seqId;
+        ack.header.status = ReqStatus::OK;
+        post(getSrcEndpoint(msg), move(ack));
+    }
+
+    void handleSyncAck(const Message &ack) {
+        auto streamPos = syncStreams.find(uint32_t(ack.header.transaction));
+        if (streamPos == syncStreams.end())
+            return;
+        auto &stream = streamPos->second;
+        // Only the replica the stream goes to retires its chunks
+        if (!(getSrcEndpoint(ack) == stream.remote))
+            return;
+        for (auto &chunk : stream.inflight) {
+            if (chunk.seqId == ack.header.seqId)
+                chunk.acked = true;
+        }
+        while (!stream.inflight.empty() && stream.inflight.front().acked)
+            stream.inflight.pop_front();
+
+        pumpSync(streamPos->first, stream);
+        if (stream.inflight.empty())
+            syncStreams.erase(streamPos);
+    }
+
+    // Sends chunks from the cursor on while the window has room
+    void pumpSync(uint32_t streamId, SyncStream &stream) {
+        while (stream.inflight.size() < SYNC_WINDOW
+               && stream.cursor < stream.keys.size()) {
+            auto chunk = SyncChunk{ stream.cursor, stream.cursor,
+                                    stream.nextSeqId++, syncTick, 0, false };
+            auto msg = makeSyncChunk(streamId, stream, chunk);
+            stream.cursor = chunk.end;
+            stream.inflight.push_back(chunk);
+            post(stream.remote, move(msg));
+        }
+    }
+
+    /**
+     * Fills the chunk from chunk.begin. A chunk sent before keeps its
+     * keys, a new one takes keys until BATCH_BYTES or half of the largest
+     * payload. A key too large for any chunk is skipped.
+     */
+    Message makeSyncChunk(uint32_t streamId, const SyncStream &stream,
+                          SyncChunk &chunk) {
+        auto msg = createMessage(ReqType::SYNC_BEGIN);
+        msg.header.transaction = int32_t(streamId);
+        msg.header.seqId = chunk.seqId;
+
+        auto isNew = chunk.end == chunk.begin;
+        auto budget = min(BATCH_BYTES, msgQueue->getMaxPayload() / 2);
+        auto used = size_t(0);
+        auto keyIdx = chunk.begin;
+        for (; keyIdx < stream.keys.size(); ++keyIdx) {
+            if (!isNew && keyIdx == chunk.end)
+                break;
+            auto &key = stream.keys[keyIdx];
+            auto kv = hashTable.find(key);
+            if (kv == hashTable.end())
+                continue;
+            auto entrySize = key.size() + kv->second.size()
+                           + MAP_ENTRY_OVERHEAD;
+            if (isNew && used + entrySize > budget && used > 0)
+                break;
+            if (entrySize > budget)
+                continue;
+            used += entrySize;
+            msg.body.keyValueMap.emplace(key, kv->second);
+        }
+        chunk.end = keyIdx;
+        return msg;
+    }
+
+    // Called once per tick, a stream whose chunk ran out of resends is
+    // given up, the replica gets the keys from a later sync
+    void resendExpiredChunks() {
+        for (auto &streamEntry : syncStreams) {
+            auto &stream = streamEntry.second;
+            // Chunks still waiting for the link would only pile up
+            auto deferredPos = deferredMsgs.find(stream.remote);
+            if (deferredPos != deferredMsgs.end()
+                    && !deferredPos->second.empty()) {
+                continue;
+            }
+            for (auto &chunk : stream.inflight) {
+                if (chunk.acked || syncTick - chunk.sentAt < SYNC_TIMEOUT)
+                    continue;
+                if (chunk.resends++ == SYNC_MAX_RESENDS) {
+                    stream.keys.clear();
+                    stream.inflight.clear();
+                    break;
+                }
+                chunk.sentAt = syncTick;
+                post(stream.remote,
+                     makeSyncChunk(streamEntry.first, stream, chunk));
+            }
+        }
+        eraseFinishedStreams();
+    }
+
+    void eraseFinishedStreams() {
+        for (auto streamPos = syncStreams.begin();
+                streamPos != syncStreams.end();) {
+            auto &stream = streamPos->second;
+            if (stream.inflight.empty() && stream.cursor >= stream.keys.size())
+                streamPos = syncStreams.erase(streamPos);
+            else
+                ++streamPos;
+        }
     }
 
     Message createMessage(ReqType::type type) {
@@ -517,31 +893,70 @@ public:
         return msg;
     }
 
+    // Sends now, or keeps the message until the link gets writable again.
+    // Messages to the same remote always leave in the order of posting.
+    void post(const Address &remote, Message &&msg) {
+        auto &deferred = deferredMsgs[remote];
+        if (deferred.empty() && send(remote, msg) != -EAGAIN)
+            return;
+        deferred.push_back(move(msg));
+    }
+
+    void resumeDeferred(const Address &remote) {
+        auto deferredPos = deferredMsgs.find(remote);
+        if (deferredPos == deferredMsgs.end())
+            return;
+        auto &deferred = deferredPos->second;
+        while (!deferred.empty() &&
+               send(remote, deferred.front()) != -EAGAIN) {
+            deferred.pop_front();
+        }
+    }
+
+    // A multi key response too large to send goes without its entries, so
+    // the coordinator fails its keys on this node instead of timing out
+    int send(const Address &remote, Message &msg) {
+        auto result = msgQueue->send(remote, msg);
+        auto isMultiRsp = msg.header.type == ReqType::MULTI_GET_RSP
+                       || msg.header.type == ReqType::MULTI_PUT_RSP;
+        if (result != -EMSGSIZE || !isMultiRsp)
+            return result;
+        msg.body.keyValueMap.clear();
+        msg.header.status = ReqStatus::FAIL;
+        return msgQueue->send(remote, msg);
+    }
+
 private:
     using MsgQueuePtr = shared_ptr<MessageQueue>;
     using HashTable = unordered_map<string, string>;
+    using DeferredMsgs = unordered_map<Address, deque<Message>>;
 
     uint64_t            transaction = 0;
     size_t              replicationFactor;
     Address             thisNodeAddr;
-    Address             nextNodeAddr;
     MembershipProxy     membershipProxy;
-    RingPartitioner     partitioner;
+    shared_ptr<Partitioner> partitioner;
     HashTable           hashTable;
     MsgQueuePtr         msgQueue;
+    DeferredMsgs        deferredMsgs;
     CommandLogger       requestsLoger;
+    unordered_map<uint32_t, SyncStream> syncStreams;
+    uint32_t            syncTick = 0;
 };
 
 
 class RingDHTCoordinator : public DHTCoordinator {
 public:
     RingDHTCoordinator(shared_ptr<MessageQueue> msgQueue,
-            RingPartitioner partitioner, MembershipProxy membershipProxy,
-            Log *log)
-                : partitioner(partitioner),
+            shared_ptr<Partitioner> partitioner,
+            MembershipProxy membershipProxy, Log *log)
+                : partitioner(move(partitioner)),
                   requestsLoger(log, msgQueue->getLocalAddress(), true) {
         this->membershipProxy = membershipProxy;
         this->msgQueue = msgQueue;
+        this->msgQueue->onWritable([this](const Address &) {
+            resumeThrottledCommands();
+        });
     }
 
     void create(string &&key, string &&value) override {
@@ -549,7 +964,7 @@ public:
         msg.header.transaction = ++transaction;
         msg.body.key = key;
         msg.body.value = move(value);
-        auto createCommand = Command(getNaturalNodes(move(key)), move(msg));
+        auto createCommand = Command(getNaturalNodes(key), move(msg));
         execute(move(createCommand));
     }
 
@@ -569,7 +984,7 @@ public:
         msg.header.transaction = ++transaction;
         msg.body.key = key;
         msg.body.value = move(value);
-        auto createCommand = Command(getNaturalNodes(move(key)), move(msg));
+        auto createCommand = Command(getNaturalNodes(key), move(msg));
         execute(move(createCommand));
     }
 
@@ -581,11 +996,65 @@ public:
         execute(move(removeCommand));
     }
 
-    bool probe(Message &msg) override {
-        static auto msgTypes = set<uint8_t>{
-            ReqType::READ_RSP, ReqType::DELETE_RSP, ReqType::CREATE_RSP, ReqType::UPDATE_RSP
+    void multiGet(const vector<string> &keys) override {
+        auto msg = createMessage(ReqType::MULTI_GET);
+        msg.header.transaction = ++transaction;
+        auto multiCommand = MultiCommand(move(msg));
+        auto budget = min(BATCH_BYTES, msgQueue->getMaxPayload() / 2);
+        auto keyOf = [](const string &key) -> const string& {
+            return key;
+        };
+        partitioner->refresh(*membershipProxy);
+        hashBlocks(keys.begin(), keys.end(), keyOf,
+                   [&](const vector<string>::const_iterator *items,
+                       const uint64_t *keyHashes, size_t count) {
+            partitioner->getNaturalNodes(keyHashes, count, blockNodes,
+                                         blockScratch);
+            for (size_t i = 0; i < count; ++i)
+                multiCommand.addKey(*items[i], string(), blockNodes[i], budget);
+        });
+        execute(move(multiCommand));
+    }
+
+    void multiPut(KeyValueMap &&entries) override {
+        auto msg = createMessage(ReqType::MULTI_PUT);
+        msg.header.transaction = ++transaction;
+        auto multiCommand = MultiCommand(move(msg));
+        auto budget = min(BATCH_BYTES, msgQueue->getMaxPayload() / 2);
+        auto keyOf = [](const KeyValueMap::value_type &kv) -> const string& {
+            return kv.first;
         };
-        return msgTypes.count(msg.header.type) > 0;
+        partitioner->refresh(*membershipProxy);
+        hashBlocks(entries.begin(), entries.end(), keyOf,
+                   [&](const KeyValueMap::iterator *items,
+                       const uint64_t *keyHashes, size_t count) {
+            partitioner->getNaturalNodes(keyHashes, count, blockNodes,
+                                         blockScratch);
+            for (size_t i = 0; i < count; ++i) {
+                multiCommand.addKey(items[i]->first, move(items[i]->second),
+                                    blockNodes[i], budget);
+            }
+        });
+        execute(move(multiCommand));
+    }
+
+    bool handles(int type) override {
+        return type == ReqType::READ_RSP || type == ReqType::DELETE_RSP
+            || type == ReqType::CREATE_RSP || type == ReqType::UPDATE_RSP
+            || type == ReqType::MULTI_GET_RSP
+            || type == ReqType::MULTI_PUT_RSP;
+    }
+
+    // Commands finish once their outcome is logged, later responses
+    // change nothing
+    bool awaits(const Header &header) override {
+        if (header.type == ReqType::MULTI_GET_RSP
+                || header.type == ReqType::MULTI_PUT_RSP) {
+            return pendingMultiCommands.count(header.transaction) > 0;
+        }
+        auto commandIterator = pendingCommands.find(header.transaction);
+        return commandIterator != pendingCommands.end()
+            && !commandIterator->second.hasFinished();
     }
 
     void handle(Message &msg) override {
@@ -597,9 +1066,37 @@ public:
             handleReadResponse(msg);
         } else if (msg.header.type == ReqType::UPDATE_RSP) {
             handleUpdate(msg);
+        } else if (msg.header.type == ReqType::MULTI_GET_RSP
+                   || msg.header.type == ReqType::MULTI_PUT_RSP) {
+            handleMultiResponse(msg);
         }
     }
 
+    void handleMultiResponse(const Message &msg) {
+        auto commandIterator = pendingMultiCommands.find(msg.header.transaction);
+        if (commandIterator == pendingMultiCommands.end())
+            return;
+
+        auto &command = commandIterator->second;
+        command.addResponse(msg, logKeyOutcome(command));
+        if (command.hasFinished())
+            pendingMultiCommands.erase(commandIterator);
+    }
+
+    // Logs each key of command once a quorum decided it
+    std::function<void(const string&, const MultiCommand::KeyEntry&)>
+    logKeyOutcome(MultiCommand &command) {
+        auto &req = command.getRequest();
+        return [this, &req](const string &key,
+                            const MultiCommand::KeyEntry &entry) {
+            auto quorumMin = entry.endpointsCount/2 + 1;
+            if (entry.successRspCount >= quorumMin)
+                requestsLoger.logKeySuccess(req, key, entry.value);
+            else
+                requestsLoger.logKeyFailure(req, key, entry.value);
+        };
+    }
+
     void handleCreateResponse(Message &msg) {
         auto reqTransaction = msg.header.transaction;
         auto commandIterator = pendingCommands.find(reqTransaction);
@@ -685,27 +1182,80 @@ public:
 
     void execute(Command&& command) {
         pendingCommands.emplace(transaction, move(command));
-        pendingCommands[transaction].multicast(msgQueue);
+        activeCommands.push_back(transaction);
+        if (!pendingCommands[transaction].multicast(msgQueue))
+            throttledCommands.push_back(transaction);
     }
 
+    void execute(MultiCommand&& command) {
+        auto &pending = pendingMultiCommands[transaction];
+        pending = move(command);
+        if (!pending.multicast(msgQueue, logKeyOutcome(pending)))
+            throttledCommands.push_back(transaction);
+        if (pending.hasFinished())
+            pendingMultiCommands.erase(transaction);
+    }
+
+    // Retries commands whose multicast was cut short by saturated links
+    void resumeThrottledCommands() {
+        auto isSent = [this](uint32_t transaction) {
+            auto multiIterator = pendingMultiCommands.find(transaction);
+            if (multiIterator != pendingMultiCommands.end()) {
+                auto &command = multiIterator->second;
+                return command.multicast(msgQueue, logKeyOutcome(command));
+            }
+            auto commandIterator = pendingCommands.find(transaction);
+            if (commandIterator == pendingCommands.end())
+                return true;
+            auto &command = commandIterator->second;
+            return command.hasFinished() || command.multicast(msgQueue);
+        };
+        throttledCommands.erase(remove_if(throttledCommands.begin(),
+                                          throttledCommands.end(), isSent),
+                                throttledCommands.end());
+    }
+
+    // Counts down timeouts of unfinished commands, called once per tick
+    // while there are any
     void onClusterUpdate() override {
-        for (auto &hashCommandPair : pendingCommands) {
-            auto &command = get<1>(hashCommandPair);
+        auto isDone = [this](uint32_t transaction) {
+            auto &command = pendingCommands[transaction];
             if (command.hasFinished())
-                continue;
+                return true;
 
             command.updateTimeLeft();
             if (command.getTimeLeft() == 0) {
                 requestsLoger.logFailure(command.getRequest());
                 command.finish();
+                return true;
             }
+            return false;
+        };
+        activeCommands.erase(remove_if(activeCommands.begin(),
+                                       activeCommands.end(), isDone),
+                             activeCommands.end());
+
+        for (auto multiIterator = pendingMultiCommands.begin();
+                multiIterator != pendingMultiCommands.end();) {
+            auto &command = multiIterator->second;
+            command.updateTimeLeft();
+            if (command.getTimeLeft() == 0)
+                command.finish(logKeyOutcome(command));
+            if (command.hasFinished())
+                multiIterator = pendingMultiCommands.erase(multiIterator);
+            else
+                ++multiIterator;
         }
     }
 
-    AddressList getNaturalNodes(const string &key) {
-        auto members = membershipProxy->getMembersList();
-        partitioner.updateRing(members);
-        return partitioner.getNaturalNodes(key, members);
+    bool hasPendingCommands() override {
+        return !activeCommands.empty() || !pendingMultiCommands.empty();
+    }
+
+    // Valid until the next lookup
+    AddressSpan getNaturalNodes(const string &key) {
+        partitioner->refresh(*membershipProxy);
+        return partitioner->getNaturalNodes(key, naturalNodes);
     }
 
     Message createMessage(ReqType::type type) {
@@ -719,7 +1269,10 @@ public:
 
 private:
     shared_ptr<MessageQueue>    msgQueue;
-    RingPartitioner             partitioner;
+    shared_ptr<Partitioner> partitioner;
+    AddressList                 naturalNodes;   // scratch of lookups
+    AddressSpan                 blockNodes[KEY_HASH_BLOCK];
+    AddressList                 blockScratch[KEY_HASH_BLOCK];
     MembershipProxy             membershipProxy;
     CommandLogger               requestsLoger;
 
@@ -728,6 +1281,10 @@ private:
     using PendingTransactionIdentifier = pair<uint32_t, string>;
     map<PendingTransactionIdentifier, uint32_t> responseCount;
     unordered_map<uint32_t, Command>            pendingCommands;
+    // Unlike commands, multi key commands are dropped once finished
+    unordered_map<uint32_t, MultiCommand>       pendingMultiCommands;
+    vector<uint32_t>                            activeCommands;
+    vector<uint32_t>                            throttledCommands;
 };
 
 
@@ -737,53 +1294,94 @@ private:
 DistributedHashTableService::DistributedHashTableService(
         MembershipProxy membershipProxy,
         shared_ptr<MessageQueue> msgQueue,
+        const PartitionerOptions &partitionerOptions,
         Log *log) {
     static const size_t REPLICATION_FACTOR = 3;
 
     this->msgQueue = msgQueue;
 
+    auto partitioner = Partitioner::create(REPLICATION_FACTOR,
+                                           partitionerOptions);
+
     auto *dhtBacked = new (std::nothrow) RingDHTBackend(
-        msgQueue, membershipProxy, REPLICATION_FACTOR, log);
+        msgQueue, membershipProxy, partitioner, log);
     backend = shared_ptr<DHTBackend>(dhtBacked);
 
     auto *dhtCordinator = new RingDHTCoordinator(
-        msgQueue,
-        RingPartitioner(REPLICATION_FACTOR, RING_SIZE),
-        membershipProxy, log);
+        msgQueue, partitioner, membershipProxy, log);
     coordinator = unique_ptr<DHTCoordinator>(dhtCordinator);
 
+    for (auto type = 0; type <= ReqType::MULTI_PUT_RSP; ++type) {
+        if (backend->handles(type))
+            routes.push_back(Route::BACKEND);
+        else if (coordinator->handles(type))
+            routes.push_back(Route::COORDINATOR);
+        else
+            routes.push_back(Route::DROP);
+    }
+
     this->log = log;
 }
 
+// Client requests come between ticks of the node, they leave right away
 void DistributedHashTableService::create(string &&key, string &&value) {
     coordinator->create(move(key), move(value));
+    msgQueue->flush();
 }
 
 void DistributedHashTableService::read(const string &key) {
     coordinator->read(key);
+    msgQueue->flush();
 }
 
 void DistributedHashTableService::update(string &&key, string &&value) {
     coordinator->update(move(key), move(value));
+    msgQueue->flush();
 }
 
 void DistributedHashTableService::remove(const string &key) {
     coordinator->remove(key);
+    msgQueue->flush();
+}
+
+void DistributedHashTableService::multiGet(const vector<string> &keys) {
+    coordinator->multiGet(keys);
+    msgQueue->flush();
+}
+
+void DistributedHashTableService::multiPut(KeyValueMap &&entries) {
+    coordinator->multiPut(move(entries));
+    msgQueue->flush();
 }
 
 bool DistributedHashTableService::recieveMessages() {
     return msgQueue->recieveMessages();
 }
 
+/**
+ * Deferred sends resume first, then headers come and the body is decoded
+ * only when the message goes to a handler
+ */
 bool DistributedHashTableService::processMessages() {
-    while (!msgQueue->empty()) {
-        auto msg = msgQueue->dequeue();
-        if (backend->probe(msg)) {
-            backend->handle(msg);
-        } else if (coordinator->probe(msg)) {
-            coordinator->handle(msg);
+    msgQueue->notifyWritable();
+    auto count = size_t(0);
+    while ((count = msgQueue->peekBatch(inbox)) > 0) {
+        for (size_t i = 0; i < count; ++i) {
+            auto &msg = inbox[i];
+            auto type = size_t(msg.header.type);
+            auto route = type < routes.size() ? routes[type] : Route::DROP;
+
+            if (route == Route::BACKEND) {
+                msgQueue->decodeBody(i, msg);
+                backend->handle(msg);
+            } else if (route == Route::COORDINATOR
+                       && coordinator->awaits(msg.header)) {
+                msgQueue->decodeBody(i, msg);
+                coordinator->handle(msg);
+            }
         }
     }
+    msgQueue->flush();
     return true;
 }
 
@@ -794,4 +1392,13 @@ AddressList DistributedHashTableService::getNaturalNodes(const string &key) {
 void DistributedHashTableService::updateCluster() {
     backend->updateCluster();
     coordinator->onClusterUpdate();
+    msgQueue->flush();
+}
+
+/**
+ * Node has to be woken next tick even if no message comes for it
+ */
+bool DistributedHashTableService::hasPendingWork() {
+    return coordinator->hasPendingCommands() || backend->hasPendingSyncs()
+        || msgQueue->isThrottled();
 }
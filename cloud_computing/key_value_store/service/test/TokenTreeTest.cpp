@@ -0,0 +1,106 @@
+/**
+ * Checks TokenTree against lower_bound over the sorted positions it was
+ * built from, for random position sets of every size up to a few tree
+ * levels. Keys probe every position, right before and after it, the
+ * middle of every gap, and the 0 and UINT64_MAX edges of the ring. Both
+ * the single and the batched search are checked.
+ *
+ *   ./TokenTreeTest [--seed N] [--rounds N]
+ */
+
+#include "service/TokenTree.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+static uint32_t expectedRank(const vector<uint64_t> &positions,
+                             uint64_t keyHash) {
+    auto next = lower_bound(positions.begin(), positions.end(), keyHash);
+    return next == positions.end() ? 0 : uint32_t(next - positions.begin());
+}
+
+static vector<uint64_t> getProbes(const vector<uint64_t> &positions) {
+    auto probes = vector<uint64_t>{ 0, 1, UINT64_MAX - 1, UINT64_MAX };
+    for (size_t rank = 0; rank < positions.size(); ++rank) {
+        auto pos = positions[rank];
+        probes.push_back(pos - 1);
+        probes.push_back(pos);
+        probes.push_back(pos + 1);
+        auto prev = rank ? positions[rank - 1] : 0;
+        probes.push_back(prev + (pos - prev) / 2);
+    }
+    if (!positions.empty()) {
+        auto last = positions.back();
+        probes.push_back(last + (UINT64_MAX - last) / 2);
+    }
+    return probes;
+}
+
+// Positions drawn from the whole ring, or packed in a narrow band so gaps
+// of 1 and repeated positions show up, optionally at the ring edges
+static vector<uint64_t> getPositions(mt19937_64 &rng, size_t count) {
+    auto positions = vector<uint64_t>();
+    auto shape = rng() % 3;
+    auto base = rng();
+    for (size_t i = 0; i < count; ++i) {
+        if (shape == 0)
+            positions.push_back(rng());
+        else
+            positions.push_back(base + rng() % (2 * count + 1));
+    }
+    if (shape == 2 && count >= 2) {
+        positions[0] = 0;
+        positions[1] = UINT64_MAX;
+    }
+    sort(positions.begin(), positions.end());
+    return positions;
+}
+
+static bool check(const vector<uint64_t> &positions) {
+    TokenTree tree;
+    tree.build(positions);
+    auto probes = getProbes(positions);
+    auto ranks = vector<uint32_t>(probes.size());
+    tree.find(probes.data(), probes.size(), ranks.data());
+    for (size_t idx = 0; idx < probes.size(); ++idx) {
+        auto expected = expectedRank(positions, probes[idx]);
+        auto single = tree.find(probes[idx]);
+        if (single != expected || ranks[idx] != expected) {
+            fprintf(stderr, "%zu positions, key %llu: expected rank %u, "
+                    "find %u, batched find %u\n", positions.size(),
+                    (unsigned long long)probes[idx], expected, single,
+                    ranks[idx]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    auto seed = uint64_t(1);
+    auto rounds = 20;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "--seed"))
+            seed = strtoull(argv[i + 1], nullptr, 10);
+        else if (!strcmp(argv[i], "--rounds"))
+            rounds = atoi(argv[i + 1]);
+    }
+
+    auto rng = mt19937_64(seed);
+    auto sets = 0;
+    for (auto round = 0; round < rounds; ++round) {
+        for (size_t count = 1; count <= 1100; count += 1 + count / 8) {
+            if (!check(getPositions(rng, count)))
+                return 1;
+            ++sets;
+        }
+    }
+    printf("TokenTree: %d position sets match lower_bound\n", sets);
+    return 0;
+}
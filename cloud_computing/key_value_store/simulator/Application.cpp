@@ -5,9 +5,20 @@
  **********************************/
 
 #include "Application.h"
+#include "net/CoalescingTransport.h"
+#include "net/ShmTransport.h"
+#include "net/UdpTransport.h"
+#include "net/UringTransport.h"
+#include <algorithm>
 #include <memory>
+#include <numeric>
 using std::make_shared;
 
+static void sortUnique(vector<int> &nodes) {
+	sort(nodes.begin(), nodes.end());
+	nodes.erase(unique(nodes.begin(), nodes.end()), nodes.end());
+}
+
 void handler(int sig) {
 	void *array[10];
 	size_t size;
@@ -47,13 +58,16 @@ int main(int argc, char *argv[]) {
  * Constructor of the Application class
  */
 Application::Application(char *infile) {
-	srand (time(NULL));
-
 	par = unique_ptr<Params>(new Params);
 	par->setparams(infile);
+	openTrace();
+	srand(par->SEED);
+	workers = unique_ptr<WorkerPool>(new WorkerPool(par->THREADS));
 	log = unique_ptr<Log>(new Log(par.get()));
 	en = unique_ptr<EmulNet>(new EmulNet(par.get()));
     en1 = unique_ptr<EmulNet>(new EmulNet(par.get()));
+	en->ENtrace(msgTrace.get(), 1);
+	en1->ENtrace(msgTrace.get(), 2);
 	mp1.resize(par->EN_GPSZ);
     mp2.resize(par->EN_GPSZ);
 	/*
@@ -64,14 +78,21 @@ Application::Application(char *infile) {
 
         Address addressOfMemberNode;
         en->ENinit(&addressOfMemberNode, par->PORTNUM);
+        // MP2 sockets take the port range right after the MP1 one
+        auto mp1Transport = makeTransport(en.get(), &memberNode->mp1q,
+                                          addressOfMemberNode,
+                                          par->UDP_BASE_PORT);
+        auto mp2Transport = makeTransport(en1.get(), &memberNode->mp2q,
+                                          addressOfMemberNode,
+                                          par->UDP_BASE_PORT + par->EN_GPSZ + 1);
         mp1[i] = unique_ptr<MP1Node>(new MP1Node(memberNode,
                                                  par.get(),
-                                                 en.get(),
+                                                 mp1Transport,
                                                  log.get(),
                                                  addressOfMemberNode));
         mp2[i] = unique_ptr<MP2Node>(new MP2Node(memberNode,
                                                  par.get(),
-                                                 en1.get(),
+                                                 mp2Transport,
                                                  log.get(),
                                                  &addressOfMemberNode));
         log->LOG(&(mp1[i]->getMemberNode()->addr), "APP");
@@ -85,6 +106,67 @@ Application::Application(char *infile) {
 Application::~Application() {
 }
 
+/**
+ * FUNCTION NAME: openTrace
+ *
+ * DESCRIPTION: Starts recording or replaying EmulNet deliveries as the
+ * 				config asks. Replay takes the SEED of the recorded run, so
+ * 				that the workload is the same.
+ */
+void Application::openTrace() {
+	int err = 0;
+	msgTrace = unique_ptr<MsgTrace>(new MsgTrace);
+	if ( !par->TRACE_REPLAY.empty() ) {
+		err = msgTrace->startReplay(par->TRACE_REPLAY.c_str());
+		par->SEED = msgTrace->getSeed();
+	}
+	else if ( !par->TRACE_RECORD.empty() ) {
+		err = msgTrace->startRecording(par->TRACE_RECORD.c_str(), par->SEED);
+	}
+	if ( err ) {
+		fprintf(stderr, "Cannot open trace: %s\n", strerror(-err));
+		exit(1);
+	}
+}
+
+/**
+ * FUNCTION NAME: makeTransport
+ *
+ * DESCRIPTION: Creates the network backend selected by TRANSPORT config entry
+ */
+shared_ptr<net::Transport> Application::makeTransport(EmulNet *emulNet,
+                                                      Inbox *inQueue,
+                                                      Address address,
+                                                      unsigned short udpBasePort) {
+	shared_ptr<net::Transport> transport;
+	if (par->TRANSPORT == EMULNET_TRANSPORT) {
+		transport = make_shared<net::EmulNetTransport>(emulNet, inQueue, address,
+		                                               par->SEND_WINDOW);
+	}
+	// Base port also keeps rings of MP1 and MP2 apart
+	else if (par->TRANSPORT == SHM_TRANSPORT) {
+		transport = make_shared<net::ShmTransport>(inQueue, address, udpBasePort,
+		                                           par->SEND_WINDOW);
+	}
+#ifdef USE_IO_URING
+	else if (par->TRANSPORT == URING_TRANSPORT) {
+		transport = make_shared<net::UringTransport>(inQueue, address, udpBasePort,
+		                                             par->SEND_WINDOW);
+	}
+#endif
+	// Without io_uring built in URING runs on plain sockets
+	else {
+		transport = make_shared<net::UdpTransport>(inQueue, address, udpBasePort,
+		                                           par->SEND_WINDOW);
+	}
+	// Messages of a tick to the same node share one envelope
+	if (par->COALESCE > 0) {
+		transport = make_shared<net::CoalescingTransport>(transport, par->COALESCE);
+	}
+	transports.push_back(transport);
+	return transport;
+}
+
 /**
  * FUNCTION NAME: run
  *
@@ -96,10 +178,24 @@ int Application::run()
 	int timeWhenAllNodesHaveJoined = 0;
 	// boolean indicating if all nodes have joined
 	bool allNodesJoined = false;
-	srand(time(NULL));
+	bool mp2Running = false;
+	srand(par->SEED);
+
+	// With EVENT_DRIVEN, EmulNet tells which nodes got mail, so nodes with
+	// nothing due can sleep. Otherwise, and on other networks and replays,
+	// all nodes run every tick.
+	eventDriven = (par->EVENT_DRIVEN && par->TRANSPORT == EMULNET_TRANSPORT &&
+	               !msgTrace->isReplaying());
+	en->ENtrack(eventDriven);
+	en1->ENtrack(eventDriven);
+	seenMembersVersion.assign(par->EN_GPSZ, 0);
+	for ( i = 0; i < par->EN_GPSZ; i++ ) {
+		mp1Events.schedule((int)(par->STEP_RATE*i), i);
+	}
 
-	// As time runs along
-	for( par->globaltime = 0; par->globaltime < TOTAL_RUNNING_TIME; ++par->globaltime ) {
+	// As time runs along, jumping over the ticks nothing happens at
+	for( par->globaltime = 0; par->globaltime < TOTAL_RUNNING_TIME;
+	     par->globaltime = nextEventTime(timeWhenAllNodesHaveJoined, mp2Running) ) {
 		// Run the membership protocol
 		mp1Run();
 
@@ -109,17 +205,49 @@ int Application::run()
 			allNodesJoined = true;
 		}
 		if ( par->getcurrtime() > timeWhenAllNodesHaveJoined + 50 ) {
+			// The ring has to catch up with whatever happened while the
+			// KV store was not running
+			if ( !mp2Running ) {
+				for ( i = 0; i < par->EN_GPSZ; i++ ) {
+					mp2Events.schedule(par->getcurrtime(), i);
+				}
+			}
+			mp2Running = true;
 			// Call the KV store functionalities
 			mp2Run();
 		}
+		else {
+			mp2Running = false;
+		}
+		membershipChanged.clear();
 		// Fail some nodes
 		//fail();
 	}
 
+	// Pool counters go apart from msgcount.log, which keeps its format
+	BufferPoolStats poolStats = en->getBufferPoolStats();
+	BufferPoolStats kvPoolStats = en1->getBufferPoolStats();
+	printf("buffer pool: %llu hits, %llu misses, %llu slabs, %llu in use\n",
+	       (unsigned long long)(poolStats.hits + kvPoolStats.hits),
+	       (unsigned long long)(poolStats.misses + kvPoolStats.misses),
+	       (unsigned long long)(poolStats.slabs + kvPoolStats.slabs),
+	       (unsigned long long)(poolStats.inUse + kvPoolStats.inUse));
+
 	// Clean up
 	en->ENcleanup();
 	en1->ENcleanup();
 
+	// Kernel cost of the real network backends
+	if (par->TRANSPORT != EMULNET_TRANSPORT) {
+		uint64_t sent = 0, syscalls = 0;
+		for (auto &transport : transports) {
+			sent += transport->getStats().sent;
+			syscalls += transport->getStats().syscalls;
+		}
+		printf("transport: %llu messages sent, %llu syscalls\n",
+		       (unsigned long long)sent, (unsigned long long)syscalls);
+	}
+
 	for(i=0;i<=par->EN_GPSZ-1;i++) {
 		 mp1[i]->finishUpThisNode();
 	}
@@ -127,29 +255,92 @@ int Application::run()
 	return SUCCESS;
 }
 
+/**
+ * FUNCTION NAME: nextEventTime
+ *
+ * DESCRIPTION: Time of the next tick something happens at: a node wakeup,
+ * 				start of the KV store or a step of the tests
+ */
+int Application::nextEventTime(int timeWhenAllNodesHaveJoined, bool mp2Running) {
+	int now = par->getcurrtime();
+	// Tests look at the clock on every tick
+	if ( !eventDriven || now + 1 >= TEST_TIME ) {
+		return now + 1;
+	}
+
+	int next = mp1Events.nextTime();
+	if ( mp2Running ) {
+		next = min(next, mp2Events.nextTime());
+	}
+	else {
+		next = min(next, timeWhenAllNodesHaveJoined + 51);
+	}
+	if ( now < INSERT_TIME ) {
+		next = min(next, INSERT_TIME);
+	}
+	return min(max(next, now + 1), TOTAL_RUNNING_TIME);
+}
+
+/**
+ * FUNCTION NAME: popWoken
+ *
+ * DESCRIPTION: Nodes to run at the current time, all of them when the
+ * 				network does not report deliveries
+ */
+void Application::popWoken(EventQueue &events, vector<int> &woken) {
+	if ( eventDriven ) {
+		events.popDue(par->getcurrtime(), woken);
+	}
+	else {
+		woken.resize(par->EN_GPSZ);
+		iota(woken.begin(), woken.end(), 0);
+	}
+}
+
+/**
+ * FUNCTION NAME: takeWakeups
+ *
+ * DESCRIPTION: Indices of the nodes that got mail and of the nodes that
+ * 				sent since the last call
+ */
+void Application::takeWakeups(EmulNet *emulNet, vector<int> &delivered, vector<int> &active) {
+	delivered.clear();
+	active.clear();
+	emulNet->ENwakeups(delivered, active);
+	// EmulNet ids start at 1
+	for (int &node : delivered) {
+		node--;
+	}
+	for (int &node : active) {
+		node--;
+	}
+}
+
 /**
  * FUNCTION NAME: mp1Run
  *
  * DESCRIPTION:	This function performs all the membership protocol functionalities
  */
 void Application::mp1Run() {
-	int i;
+	int k, i;
+	popWoken(mp1Events, mp1Woken);
+	int wokenCount = mp1Woken.size();
 
-	// For all the nodes in the system
-	for( i = 0; i <= par->EN_GPSZ-1; i++) {
-
-		/*
-		 * Receive messages from the network and queue them in the membership protocol queue
-		 */
+	/*
+	 * Receive messages from the network and queue them in the membership protocol queue
+	 */
+	workers->forEachNode(wokenCount, [this](int k) {
+		int i = mp1Woken[k];
 		if( par->getcurrtime() > (int)(par->STEP_RATE*i) && !(mp1[i]->getMemberNode()->bFailed) ) {
 			// Receive messages from the network and queue them
 			mp1[i]->recvLoop();
 		}
+	});
 
-	}
-
-	// For all the nodes in the system
-	for( i = par->EN_GPSZ - 1; i >= 0; i-- ) {
+	// One byte per woken node, workers set their own entries
+	vector<char> introduced(wokenCount, false);
+	workers->forEachNode(wokenCount, [this, &introduced](int k) {
+		int i = mp1Woken[k];
 
 		/*
 		 * Introduce nodes into the distributed system
@@ -157,8 +348,7 @@ void Application::mp1Run() {
 		if( par->getcurrtime() == (int)(par->STEP_RATE*i) ) {
 			// introduce the ith node into the system at time STEPRATE*i
 			mp1[i]->nodeStart(JOINADDR, par->PORTNUM);
-			cout<<i<<"-th introduced node is assigned with the address: "<<mp1[i]->getMemberNode()->addr.getAddress() << endl;
-			nodeCount += i;
+			introduced[k] = true;
 		}
 
 		/*
@@ -173,7 +363,45 @@ void Application::mp1Run() {
 			}
 			#endif
 		}
+	});
 
+	// Report introductions once the phase is over, in the order of nodes
+	for( k = wokenCount - 1; k >= 0; k-- ) {
+		i = mp1Woken[k];
+		if ( introduced[k] ) {
+			cout<<i<<"-th introduced node is assigned with the address: "<<mp1[i]->getMemberNode()->addr.getAddress() << endl;
+			nodeCount += i;
+		}
+	}
+
+	if ( !eventDriven ) {
+		return;
+	}
+
+	/*
+	 * Wake nodes that got mail on the next tick and nodes in group when
+	 * their gossip is due. Changes of member lists wake the ring update.
+	 */
+	vector<int> delivered, active;
+	takeWakeups(en.get(), delivered, active);
+	for (int node : delivered) {
+		mp1Events.schedule(par->getcurrtime() + 1, node);
+	}
+	for( k = 0; k < wokenCount; k++ ) {
+		i = mp1Woken[k];
+		if ( par->getcurrtime() < (int)(par->STEP_RATE*i) || mp1[i]->getMemberNode()->bFailed ) {
+			continue;
+		}
+		if ( introduced[k] ) {
+			mp1Events.schedule(par->getcurrtime() + 1, i);
+		}
+		else if ( mp1[i]->getMemberNode()->inGroup ) {
+			mp1Events.schedule(mp1[i]->getNextTasksRun(), i);
+		}
+		if ( mp1[i]->getMembersVersion() != seenMembersVersion[i] ) {
+			seenMembersVersion[i] = mp1[i]->getMembersVersion();
+			membershipChanged.push_back(i);
+		}
 	}
 }
 
@@ -186,33 +414,51 @@ void Application::mp1Run() {
  * 				2) CRUD operations
  */
 void Application::mp2Run() {
-	int i;
-
-	// For all the nodes in the system
-	for( i = 0; i <= par->EN_GPSZ-1; i++) {
+	vector<int> delivered, active;
+	popWoken(mp2Events, mp2Woken);
+	if ( eventDriven ) {
+		mp2Woken.insert(mp2Woken.end(), membershipChanged.begin(), membershipChanged.end());
+		sortUnique(mp2Woken);
+	}
 
-		/*
-		 * 1) Update the ring
-		 * 2) Receive messages from the network and queue them in the KV store queue
-		 */
+	/*
+	 * 1) Update the ring, may send replicas to the new owners
+	 */
+	workers->forEachNode(mp2Woken.size(), [this](int k) {
+		int i = mp2Woken[k];
 		if ( par->getcurrtime() > (int)(par->STEP_RATE*i) && !mp2[i]->getMemberNode()->bFailed ) {
 			if ( mp2[i]->getMemberNode()->inited && mp2[i]->getMemberNode()->inGroup ) {
-				// Step 1
 				mp2[i]->updateRing();
 			}
-			// Step 2
-			mp2[i]->recvLoop();
 		}
+	});
+
+	// Replicas sent by the ring update are received on this same tick
+	if ( eventDriven ) {
+		takeWakeups(en1.get(), delivered, active);
+		mp2Woken.insert(mp2Woken.end(), delivered.begin(), delivered.end());
+		sortUnique(mp2Woken);
 	}
 
+	/*
+	 * 2) Receive messages from the network and queue them in the KV store queue
+	 */
+	workers->forEachNode(mp2Woken.size(), [this](int k) {
+		int i = mp2Woken[k];
+		if ( par->getcurrtime() > (int)(par->STEP_RATE*i) && !mp2[i]->getMemberNode()->bFailed ) {
+			mp2[i]->recvLoop();
+		}
+	});
+
 	/**
 	 * Handle messages from the queue and update the DHT
 	 */
-	for ( i = par->EN_GPSZ-1; i >= 0; i-- ) {
+	workers->forEachNode(mp2Woken.size(), [this](int k) {
+		int i = mp2Woken[k];
 		if ( par->getcurrtime() > (int)(par->STEP_RATE*i) && !mp2[i]->getMemberNode()->bFailed ) {
 			mp2[i]->checkMessages();
 		}
-	}
+	});
 
 	/**
 	 * Insert a set of test key value pairs into the system
@@ -320,6 +566,26 @@ void Application::mp2Run() {
 		} // End of update test
 
 	} // end of if ( par->getcurrtime == TEST_TIME)
+
+	if ( !eventDriven ) {
+		return;
+	}
+
+	/*
+	 * Wake nodes that got mail on the next tick, as well as nodes that
+	 * wait for responses or for their links to drain
+	 */
+	takeWakeups(en1.get(), delivered, active);
+	for (int node : delivered) {
+		mp2Events.schedule(par->getcurrtime() + 1, node);
+	}
+	active.insert(active.end(), mp2Woken.begin(), mp2Woken.end());
+	sortUnique(active);
+	for (int node : active) {
+		if ( !mp2[node]->getMemberNode()->bFailed && mp2[node]->hasPendingWork() ) {
+			mp2Events.schedule(par->getcurrtime() + 1, node);
+		}
+	}
 }
 
 /**
@@ -393,7 +659,7 @@ int Application::findARandomNodeThatIsAlive() {
  * DESCRIPTION: Init NUMBER_OF_INSERTS test KV pairs in the map
  */
 void Application::initTestKVPairs() {
-	srand(time(NULL));
+	srand(par->SEED);
 	int i;
 	string key;
 	key.clear();
@@ -422,6 +688,11 @@ void Application::insertTestKVPairs() {
 	 */
 	initTestKVPairs();
 
+	if ( par->MULTI_PUT ) {
+		insertTestKVPairsAtOnce();
+		return;
+	}
+
 	for ( map<string, string>::iterator it = testKVPairs.begin(); it != testKVPairs.end(); ++it ) {
 		// Step 1. Find a node that is alive
 		number = findARandomNodeThatIsAlive();
@@ -434,6 +705,24 @@ void Application::insertTestKVPairs() {
 	cout<<endl<<"Sent " <<testKVPairs.size() <<" create messages to the ring"<<endl;
 }
 
+/**
+ * FUNCTION NAME: insertTestKVPairsAtOnce
+ *
+ * DESCRIPTION: Inserts the test KV pairs with one multi key create through
+ * 				one coordinator. Each key completes at a quorum of its
+ * 				replicas and is logged as a create of its own.
+ */
+void Application::insertTestKVPairsAtOnce() {
+	int number = findARandomNodeThatIsAlive();
+
+	for ( map<string, string>::iterator it = testKVPairs.begin(); it != testKVPairs.end(); ++it ) {
+		log->LOG(&mp2[number]->getMemberNode()->addr, "CREATE OPERATION KEY: %s VALUE: %s at time: %d", it->first.c_str(), it->second.c_str(), par->getcurrtime());
+	}
+	mp2[number]->clientMultiPut(testKVPairs);
+
+	cout<<endl<<"Sent " <<testKVPairs.size() <<" create messages to the ring"<<endl;
+}
+
 /**
  * FUNCTION NAME: deleteTest
  *
@@ -16,6 +16,8 @@
 #include "Queue.h"
 #include "MP2Node.h"
 #include "Node.h"
+#include "WorkerPool.h"
+#include "EventQueue.h"
 #include "common.h"
 
 #include <memory>
@@ -57,12 +59,24 @@ private:
 	// Coordinator Node
 	char JOINADDR[30];
 	unique_ptr<Params>          par;
+	unique_ptr<MsgTrace>        msgTrace;
 	unique_ptr<EmulNet>         en;
     unique_ptr<EmulNet>         en1;
 	unique_ptr<Log>             log;
 	vector<unique_ptr<MP1Node>> mp1;
     vector<unique_ptr<MP2Node>> mp2;
 	map<string, string>         testKVPairs;
+	vector<shared_ptr<net::Transport>> transports;
+	unique_ptr<WorkerPool>      workers;
+	// Wakeups of the nodes, only used when sends tell who got mail
+	bool                        eventDriven;
+	EventQueue                  mp1Events;
+	EventQueue                  mp2Events;
+	vector<int>                 mp1Woken;
+	vector<int>                 mp2Woken;
+	vector<uint64_t>            seenMembersVersion;
+	// Nodes whose member list changed since MP2 last looked at them
+	vector<int>                 membershipChanged;
 public:
 	Application(char *);
 	virtual ~Application();
@@ -73,10 +87,19 @@ public:
 	void mp2Run();
 	void fail();
 	void insertTestKVPairs();
+	void insertTestKVPairsAtOnce();
 	int findARandomNodeThatIsAlive();
 	void deleteTest();
 	void readTest();
 	void updateTest();
+private:
+	shared_ptr<net::Transport> makeTransport(EmulNet *, Inbox *,
+	                                         Address, unsigned short);
+	void popWoken(EventQueue &events, vector<int> &woken);
+	void openTrace();
+	void takeWakeups(EmulNet *emulNet, vector<int> &delivered,
+	                 vector<int> &active);
+	int nextEventTime(int timeWhenAllNodesHaveJoined, bool mp2Running);
 };
 
 #endif /* _APPLICATION_H__ */
@@ -0,0 +1,196 @@
+/**********************************
+ * FILE NAME: BufferPool.cpp
+ *
+ * DESCRIPTION: Size-class slab allocator for message buffers
+ **********************************/
+
+#include "BufferPool.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+static const size_t   MIN_BLOCK_SHIFT = 6;              // 64 B blocks
+static const uint32_t CLASSES_COUNT   = 11;             // up to 64 KiB blocks
+static const size_t   SLAB_SIZE       = 64 * 1024;
+static const uint32_t OVERSIZED       = CLASSES_COUNT;  // plain malloc
+static const uint32_t SHARED_TAG      = UINT32_MAX;     // owner is a SharedBlock
+
+static size_t blockSizeOf(uint32_t sizeClass) {
+    return size_t(1) << (MIN_BLOCK_SHIFT + sizeClass);
+}
+
+static uint32_t sizeClassOf(size_t size) {
+    auto sizeClass = 0u;
+    while (sizeClass < CLASSES_COUNT && blockSizeOf(sizeClass) < size)
+        ++sizeClass;
+    return sizeClass;
+}
+
+/**
+ * Stands between the handles of a shared buffer and the real owner of its
+ * block, handles may be released from any thread. It lives in a small
+ * block of a pool, so sharing allocates nothing once the pool is warm.
+ */
+class SharedBlock : public BufferOwner {
+public:
+    static SharedBlock* create(BufferOwner *owner, uint32_t tag) {
+        auto *headerPool = owner->getHeaderPool();
+        if (headerPool == nullptr)
+            headerPool = &getDefaultHeaderPool();
+        auto header = headerPool->allocate(sizeof(SharedBlock));
+        auto *memory = header.data();
+        return new (memory) SharedBlock(owner, tag, std::move(header));
+    }
+
+    void addRef() {
+        refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void recycle(char *block, uint32_t) override {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+        owner->recycle(block, tag);
+        // The handle of the block this lives in goes last
+        auto memory = std::move(header);
+        this->~SharedBlock();
+    }
+
+private:
+    SharedBlock(BufferOwner *owner, uint32_t tag, PooledBuffer &&header)
+        : owner(owner), tag(tag), refs(1), header(std::move(header)) { }
+
+    // Headers of owners that are not pools, lives until exit
+    static BufferPool& getDefaultHeaderPool() {
+        static BufferPool headerPool;
+        return headerPool;
+    }
+
+    BufferOwner             *owner;
+    uint32_t                tag;
+    std::atomic<uint32_t>   refs;
+    PooledBuffer            header;
+};
+
+static_assert(sizeof(SharedBlock) <= (size_t(1) << MIN_BLOCK_SHIFT),
+              "shared block header fits the smallest size class");
+
+/******************************************************************************
+ * PooledBuffer
+ ******************************************************************************/
+PooledBuffer::PooledBuffer(BufferOwner *owner, char *block, uint32_t tag,
+                           char *data, size_t size)
+    : owner(owner), block(block), tag(tag), dataPtr(data), dataSize(size) {
+}
+
+PooledBuffer::PooledBuffer(PooledBuffer &&another) noexcept {
+    *this = std::move(another);
+}
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer &&another) noexcept {
+    if (this == &another)
+        return *this;
+    reset();
+    owner    = another.owner;
+    block    = another.block;
+    tag      = another.tag;
+    dataPtr  = another.dataPtr;
+    dataSize = another.dataSize;
+    another.owner   = nullptr;
+    another.block   = nullptr;
+    another.dataPtr = nullptr;
+    another.dataSize = 0;
+    return *this;
+}
+
+PooledBuffer::~PooledBuffer() {
+    reset();
+}
+
+PooledBuffer PooledBuffer::share() {
+    if (block == nullptr)
+        return PooledBuffer();
+    if (tag != SHARED_TAG) {
+        owner = SharedBlock::create(owner, tag);
+        tag = SHARED_TAG;
+    }
+    static_cast<SharedBlock *>(owner)->addRef();
+    return PooledBuffer(owner, block, SHARED_TAG, dataPtr, dataSize);
+}
+
+void PooledBuffer::reset() {
+    if (block != nullptr)
+        owner->recycle(block, tag);
+    owner    = nullptr;
+    block    = nullptr;
+    dataPtr  = nullptr;
+    dataSize = 0;
+}
+
+/******************************************************************************
+ * BufferPool
+ ******************************************************************************/
+BufferPool::BufferPool() : freeLists(CLASSES_COUNT), stats{0, 0, 0, 0} {
+}
+
+BufferPool::~BufferPool() {
+    for (auto *slab : slabs)
+        free(slab);
+}
+
+PooledBuffer BufferPool::allocate(size_t size) {
+    auto sizeClass = sizeClassOf(size);
+    std::lock_guard<std::mutex> guard(lock);
+    stats.inUse++;
+
+    if (sizeClass == OVERSIZED) {
+        stats.misses++;
+        auto *block = (char *)malloc(size);
+        return PooledBuffer(this, block, OVERSIZED, block, size);
+    }
+
+    auto &freeList = freeLists[sizeClass];
+    if (freeList.empty()) {
+        stats.misses++;
+        refill(sizeClass);
+    } else {
+        stats.hits++;
+    }
+
+    auto *block = freeList.back();
+    freeList.pop_back();
+    return PooledBuffer(this, block, sizeClass, block, size);
+}
+
+void BufferPool::recycle(char *block, uint32_t sizeClass) {
+    std::lock_guard<std::mutex> guard(lock);
+    stats.inUse--;
+    if (sizeClass == OVERSIZED) {
+        free(block);
+        return;
+    }
+    freeLists[sizeClass].push_back(block);
+}
+
+BufferPoolStats BufferPool::getStats() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return stats;
+}
+
+/**
+ * Carves a new slab into blocks of the given class
+ */
+void BufferPool::refill(uint32_t sizeClass) {
+    auto blockSize = blockSizeOf(sizeClass);
+    auto blocksCount = SLAB_SIZE / blockSize;
+    auto *slab = (char *)malloc(SLAB_SIZE);
+    slabs.push_back(slab);
+    stats.slabs++;
+
+    // Free lists only grow while the pool warms up, reserve whole slab once
+    auto &freeList = freeLists[sizeClass];
+    freeList.reserve(freeList.size() + blocksCount);
+    for (auto blockIdx = blocksCount; blockIdx > 0; --blockIdx)
+        freeList.push_back(slab + (blockIdx - 1) * blockSize);
+}
@@ -0,0 +1,99 @@
+/**********************************
+ * FILE NAME: BufferPool.h
+ *
+ * DESCRIPTION: Size-class slab allocator for message buffers
+ **********************************/
+
+#ifndef BUFFERPOOL_H_
+#define BUFFERPOOL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+class BufferPool;
+
+/**
+ * Anything that hands out buffers and wants them back when done.
+ */
+class BufferOwner {
+public:
+    virtual ~BufferOwner() = default;
+    virtual void recycle(char *block, uint32_t tag) = 0;
+    // Pool that headers of shared buffers of this owner come from,
+    // nullptr takes them from a process wide one
+    virtual BufferPool* getHeaderPool() { return nullptr; }
+};
+
+/**
+ * RAII handle of a buffer taken from a BufferOwner. Move only, the buffer
+ * is given back to its owner when the handle goes out of scope.
+ */
+class PooledBuffer {
+public:
+    PooledBuffer() = default;
+    PooledBuffer(BufferOwner *owner, char *block, uint32_t tag,
+                 char *data, size_t size);
+    PooledBuffer(const PooledBuffer&)            = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+    PooledBuffer(PooledBuffer &&another) noexcept;
+    PooledBuffer& operator=(PooledBuffer &&another) noexcept;
+    ~PooledBuffer();
+
+    char*   data() const { return dataPtr; }
+    size_t  size() const { return dataSize; }
+    bool    empty() const { return block == nullptr; }
+    void    reset();
+    // Shrinks the data view, the block stays the same
+    void    truncate(size_t size) { if (size < dataSize) dataSize = size; }
+    // Another handle to the same bytes, the block goes back to its owner
+    // once every handle is gone. Shared bytes must not be written anymore.
+    PooledBuffer share();
+
+private:
+    BufferOwner *owner    = nullptr;
+    char        *block    = nullptr;
+    uint32_t    tag       = 0;
+    char        *dataPtr  = nullptr;
+    size_t      dataSize  = 0;
+};
+
+struct BufferPoolStats {
+    uint64_t hits;      // served from a free list
+    uint64_t misses;    // needed memory from the system heap
+    uint64_t inUse;     // buffers currently handed out
+    uint64_t slabs;     // slabs carved so far
+};
+
+/**
+ * CLASS NAME: BufferPool
+ *
+ * DESCRIPTION: Power of two size classes, each backed by slabs carved into
+ *              equal blocks. Released blocks go to the free list of their
+ *              class and are never returned to the heap until the pool dies,
+ *              so the pool has to outlive every buffer it handed out.
+ *              Buffers may be allocated and given back from any thread.
+ */
+class BufferPool : public BufferOwner {
+public:
+    BufferPool();
+    BufferPool(const BufferPool&)            = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+    virtual ~BufferPool();
+
+    PooledBuffer    allocate(size_t size);
+    void            recycle(char *block, uint32_t sizeClass) override;
+    BufferPool*     getHeaderPool() override { return this; }
+    BufferPoolStats getStats() const;
+
+private:
+    void refill(uint32_t sizeClass);
+
+    std::vector<std::vector<char *>>    freeLists;
+    std::vector<char *>                 slabs;
+    BufferPoolStats                     stats;
+    mutable std::mutex                  lock;
+};
+
+#endif /* BUFFERPOOL_H_ */
@@ -5,24 +5,205 @@
  **********************************/
 
 #include "EmulNet.h"
+#include "WorkerPool.h"
+
+#include <errno.h>
+
+// Trace starts with the magic, version and SEED, then come the records
+static const char TRACE_MAGIC[4] = { 'K', 'V', 'T', 'R' };
+static const uint32_t TRACE_VERSION = 1;
+
+struct __attribute__((packed)) TraceRecordHeader {
+	int32_t time;
+	int32_t from;
+	int32_t to;
+	uint16_t size;
+	uint8_t channel;
+};
+
+/**
+ * Constructor
+ */
+MsgCounter::MsgCounter(int bucketWidth, int nodesCount): bucketWidth(bucketWidth > 0 ? bucketWidth : 1) {
+	// Rows of known nodes exist up front, each one is then only touched by
+	// the worker of its node
+	nodes.resize(nodesCount + 1);
+}
+
+/**
+ * FUNCTION NAME: at
+ *
+ * DESCRIPTION: Return the bucket of node at time, growing the storage if needed
+ */
+MsgCounter::Bucket& MsgCounter::at(int node, int time) {
+	assert(node >= 0 && time >= 0);
+	if ( node >= (int)nodes.size() ) {
+		nodes.resize(node + 1);
+	}
+	vector<Bucket> &buckets = nodes[node];
+	int bucket = time / bucketWidth;
+	if ( bucket >= (int)buckets.size() ) {
+		buckets.resize(bucket + 1, Bucket{0, 0});
+	}
+	return buckets[bucket];
+}
+
+void MsgCounter::countSent(int node, int time) {
+	at(node, time).sent++;
+}
+
+void MsgCounter::countRecv(int node, int time) {
+	at(node, time).recv++;
+}
+
+/**
+ * FUNCTION NAME: get
+ *
+ * DESCRIPTION: Counts of a single bucket, zeros if the node never used it
+ */
+MsgCounter::Bucket MsgCounter::get(int node, int bucket) const {
+	if ( node < 0 || node >= (int)nodes.size() || bucket >= (int)nodes[node].size() ) {
+		return Bucket{0, 0};
+	}
+	return nodes[node][bucket];
+}
+
+int MsgCounter::getBucketWidth() const {
+	return bucketWidth;
+}
+
+/**
+ * FUNCTION NAME: getBucketsCount
+ *
+ * DESCRIPTION: Number of buckets needed to cover [0, time)
+ */
+int MsgCounter::getBucketsCount(int time) const {
+	return (time + bucketWidth - 1) / bucketWidth;
+}
 
 /**
  * Constructor
  */
-EmulNet::EmulNet(Params *p)
+MsgTrace::MsgTrace(): file(NULL), replaying(false), seed(0) {}
+
+/**
+ * Destructor
+ */
+MsgTrace::~MsgTrace() {
+	if ( file ) {
+		fclose(file);
+	}
+}
+
+/**
+ * FUNCTION NAME: startRecording
+ *
+ * DESCRIPTION: Create the trace file, seed is kept so that replay runs
+ * 				the same workload
+ *
+ * RETURNS:
+ * 0 on success, -errno otherwise
+ */
+int MsgTrace::startRecording(const char *path, unsigned seed) {
+	file = fopen(path, "wb");
+	if ( !file ) {
+		return -errno;
+	}
+	this->seed = seed;
+	fwrite(TRACE_MAGIC, sizeof(TRACE_MAGIC), 1, file);
+	fwrite(&TRACE_VERSION, sizeof(TRACE_VERSION), 1, file);
+	fwrite(&seed, sizeof(seed), 1, file);
+	return 0;
+}
+
+/**
+ * FUNCTION NAME: startReplay
+ *
+ * DESCRIPTION: Load all the records of a trace file
+ *
+ * RETURNS:
+ * 0 on success, -errno otherwise, -EINVAL if the file is not a trace
+ */
+int MsgTrace::startReplay(const char *path) {
+	FILE *in = fopen(path, "rb");
+	if ( !in ) {
+		return -errno;
+	}
+
+	char magic[4];
+	uint32_t version;
+	if ( fread(magic, sizeof(magic), 1, in) != 1 || memcmp(magic, TRACE_MAGIC, sizeof(magic))
+	     || fread(&version, sizeof(version), 1, in) != 1 || version != TRACE_VERSION
+	     || fread(&seed, sizeof(seed), 1, in) != 1 ) {
+		fclose(in);
+		return -EINVAL;
+	}
+
+	TraceRecordHeader header;
+	while ( fread(&header, sizeof(header), 1, in) == 1 ) {
+		Record rec{ header.time, header.from, string(header.size, '\0') };
+		if ( header.size && fread(&rec.payload[0], header.size, 1, in) != 1 ) {
+			break;
+		}
+		records[make_pair((int)header.channel, (int)header.to)].push_back(move(rec));
+	}
+	fclose(in);
+	replaying = true;
+	return 0;
+}
+
+bool MsgTrace::isRecording() const {
+	return file != NULL;
+}
+
+bool MsgTrace::isReplaying() const {
+	return replaying;
+}
+
+unsigned MsgTrace::getSeed() const {
+	return seed;
+}
+
+/**
+ * FUNCTION NAME: record
+ *
+ * DESCRIPTION: Append a delivered message, may be called from any worker
+ */
+void MsgTrace::record(int channel, int time, int from, int to, const char *data, int size) {
+	TraceRecordHeader header{ time, from, to, (uint16_t)size, (uint8_t)channel };
+	lock_guard<mutex> guard(lock);
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(data, size, 1, file);
+}
+
+/**
+ * FUNCTION NAME: replayed
+ *
+ * DESCRIPTION: Recorded messages of a node in the order of delivery, NULL
+ * 				if it never got any. Each node only touches its own queue.
+ */
+deque<MsgTrace::Record>* MsgTrace::replayed(int channel, int to) {
+	auto recordsPos = records.find(make_pair(channel, to));
+	if ( recordsPos == records.end() ) {
+		return NULL;
+	}
+	return &recordsPos->second;
+}
+
+/**
+ * Constructor
+ */
+EmulNet::EmulNet(Params *p, int msgCountBucketWidth): msgCounter(msgCountBucketWidth, p->EN_GPSZ)
 {
 	//trace.funcEntry("EmulNet::EmulNet");
-	int i,j;
 	par = p;
 	emulnet.setNextId(1);
 	emulnet.settCurrBuffSize(0);
 	enInited=0;
-	for ( i = 0; i < MAX_NODES; i++ ) {
-		for ( j = 0; j < MAX_TIME; j++ ) {
-			sent_msgs[i][j] = 0;
-			recv_msgs[i][j] = 0;
-		}
-	}
+	tracking=false;
+	trace=NULL;
+	traceChannel=0;
+	initLanes();
 	//trace.funcExit("EmulNet::EmulNet", SUCCESS);
 }
 
@@ -30,35 +211,81 @@ EmulNet::EmulNet(Params *p)
  * Copy constructor
  */
 EmulNet::EmulNet(EmulNet &anotherEmulNet) {
-	int i, j;
 	this->par = anotherEmulNet.par;
 	this->enInited = anotherEmulNet.enInited;
-	for ( i = 0; i < MAX_NODES; i++ ) {
-		for ( j = 0; j < MAX_TIME; j++ ) {
-			this->sent_msgs[i][j] = anotherEmulNet.sent_msgs[i][j];
-			this->recv_msgs[i][j] = anotherEmulNet.recv_msgs[i][j];
-		}
-	}
+	this->msgCounter = anotherEmulNet.msgCounter;
 	this->emulnet = anotherEmulNet.emulnet;
+	this->tracking = anotherEmulNet.tracking;
+	this->trace = anotherEmulNet.trace;
+	this->traceChannel = anotherEmulNet.traceChannel;
+	initLanes();
+	this->dropRngs = anotherEmulNet.dropRngs;
+	copyMessages(anotherEmulNet);
 }
 
 /**
  * Assignment operator overloading
  */
 EmulNet& EmulNet::operator =(EmulNet &anotherEmulNet) {
-	int i, j;
 	this->par = anotherEmulNet.par;
 	this->enInited = anotherEmulNet.enInited;
-	for ( i = 0; i < MAX_NODES; i++ ) {
-		for ( j = 0; j < MAX_TIME; j++ ) {
-			this->sent_msgs[i][j] = anotherEmulNet.sent_msgs[i][j];
-			this->recv_msgs[i][j] = anotherEmulNet.recv_msgs[i][j];
-		}
-	}
+	this->msgCounter = anotherEmulNet.msgCounter;
 	this->emulnet = anotherEmulNet.emulnet;
+	this->dropRngs = anotherEmulNet.dropRngs;
+	copyMessages(anotherEmulNet);
 	return *this;
 }
 
+/**
+ * FUNCTION NAME: initLanes
+ *
+ * DESCRIPTION: Create mailboxes of all the nodes with a lane per worker.
+ * 				Mailboxes are never added later, so parallel senders can
+ * 				look them up without locking.
+ */
+void EmulNet::initLanes() {
+	lanesCount = max(1, par->THREADS);
+	bufferPools.clear();
+	for ( int lane = 0; lane < lanesCount; lane++ ) {
+		bufferPools.push_back(unique_ptr<BufferPool>(new BufferPool));
+	}
+	deliveries.assign(lanesCount, vector<int>());
+	senders.assign(lanesCount, vector<int>());
+	dropRngs.clear();
+	for ( int id = 0; id <= par->EN_GPSZ; id++ ) {
+		seed_seq seed{ (unsigned)par->SEED, (unsigned)id };
+		dropRngs.push_back(mt19937(seed));
+		if ( id > 0 ) {
+			emulnet.mailboxes[Address(id, 0)].lanes.resize(lanesCount);
+		}
+	}
+}
+
+/**
+ * FUNCTION NAME: copyMessages
+ *
+ * DESCRIPTION: Copy in-flight messages of another EmulNet into buffers of this one
+ */
+void EmulNet::copyMessages(EmulNet &anotherEmulNet) {
+	emulnet.mailboxes.clear();
+	for (auto &mailbox : anotherEmulNet.emulnet.mailboxes) {
+		EM::Mailbox &copy = emulnet.mailboxes[mailbox.first];
+		copy.lanes.resize(lanesCount);
+		for ( size_t lane = 0; lane < mailbox.second.lanes.size(); lane++ ) {
+			EM::Lane &from = mailbox.second.lanes[lane];
+			EM::Lane &to = copy.lanes[lane % lanesCount];
+			for (auto &emsg : from.msgs) {
+				PooledBuffer payload = bufferPools[0]->allocate(emsg.size);
+				memcpy(payload.data(), emsg.payload.data(), emsg.size);
+				to.msgs.push_back(en_msg{ emsg.size, emsg.from, emsg.to, move(payload) });
+			}
+			for (auto &link : from.inflight) {
+				to.inflight[link.first] += link.second;
+			}
+		}
+	}
+}
+
 /**
  * Destructor
  */
@@ -82,55 +309,107 @@ void *EmulNet::ENinit(Address *myaddr, short port) {
  * DESCRIPTION: EmulNet send function
  *
  * RETURNS:
- * size
+ * size, 0 if the message got lost on the way, -EMSGSIZE if it is too large,
+ * -EAGAIN if the network buffer is full
  */
 int EmulNet::ENsend(Address *myaddr, Address *toaddr, char *data, int size) {
-	en_msg *em;
-	static char temp[2048];
-	int sendmsg = rand() % 100;
-
-	if( (emulnet.currbuffsize >= ENBUFFSIZE) || (size + (int)sizeof(en_msg) >= par->MAX_MSG_SIZE) || (par->dropmsg && sendmsg < (int) (par->MSG_DROP_PROB * 100)) ) {
-		return 0;
+	if( size + (int)EN_MSG_HEADER_SIZE >= par->MAX_MSG_SIZE ) {
+		return -EMSGSIZE;
 	}
+	PooledBuffer payload = ENalloc(size);
+	memcpy(payload.data(), data, size);
+	return ENsend(myaddr, toaddr, move(payload));
+}
 
-	em = (en_msg *)malloc(sizeof(en_msg) + size);
-	em->size = size;
-
-	memcpy(&(em->from.addr), &(myaddr->addr), sizeof(em->from.addr));
-	memcpy(&(em->to.addr), &(toaddr->addr), sizeof(em->from.addr));
-	memcpy(em + 1, data, size);
+/**
+ * FUNCTION NAME: ENsend
+ *
+ * DESCRIPTION: EmulNet send function, the payload is queued without a copy.
+ * 				It may be a shared handle, as long as nobody writes to it.
+ *
+ * RETURNS:
+ * same as ENsend above
+ */
+int EmulNet::ENsend(Address *myaddr, Address *toaddr, PooledBuffer &&payload) {
+	int src = *(int *)(myaddr->addr);
+	int lane = WorkerPool::currentWorker();
+	int size = payload.size();
 
-	emulnet.buff[emulnet.currbuffsize++] = em;
+	if( tracking && (senders[lane].empty() || senders[lane].back() != src) ) {
+		senders[lane].push_back(src);
+	}
+	if( size + (int)EN_MSG_HEADER_SIZE >= par->MAX_MSG_SIZE ) {
+		return -EMSGSIZE;
+	}
+	// Nodes only get what the trace says, their own sends go nowhere
+	if( trace && trace->isReplaying() ) {
+		msgCounter.countSent(src, par->getcurrtime());
+		return size;
+	}
+	if( emulnet.currbuffsize >= ENBUFFSIZE ) {
+		return -EAGAIN;
+	}
+	if( par->dropmsg ) {
+		int sendmsg = uniform_int_distribution<int>(0, 99)(dropRngs[src]);
+		if( sendmsg < (int) (par->MSG_DROP_PROB * 100) ) {
+			return 0;
+		}
+	}
 
-	int src = *(int *)(myaddr->addr);
-	int time = par->getcurrtime();
+	// Node that was never set up is not there to receive anything
+	auto mailboxPos = emulnet.mailboxes.find(*toaddr);
+	if (mailboxPos == emulnet.mailboxes.end()) {
+		return 0;
+	}
 
-	assert(src <= MAX_NODES);
-	assert(time < MAX_TIME);
+	EM::Lane &mailboxLane = mailboxPos->second.lanes[lane];
+	mailboxLane.msgs.push_back(en_msg{ size, *myaddr, *toaddr, move(payload) });
+	mailboxLane.inflight[*myaddr]++;
+	emulnet.currbuffsize++;
+	// First message in the lane since the last drain wakes the receiver
+	if( tracking && mailboxLane.msgs.size() == 1 ) {
+		deliveries[lane].push_back(*(int *)(toaddr->addr));
+	}
 
-	sent_msgs[src][time]++;
+	msgCounter.countSent(src, par->getcurrtime());
 
 	#ifdef DEBUGLOG
-		sprintf(temp, "Sending 4+%d B msg type %d to %d.%d.%d.%d:%d ", size-4, *(int *)data, toaddr->addr[0], toaddr->addr[1], toaddr->addr[2], toaddr->addr[3], *(short *)&toaddr->addr[4]);
+		char temp[2048];
+		sprintf(temp, "Sending 4+%d B msg type %d to %d.%d.%d.%d:%d ", size-4, *(int *)mailboxLane.msgs.back().payload.data(), toaddr->addr[0], toaddr->addr[1], toaddr->addr[2], toaddr->addr[3], *(short *)&toaddr->addr[4]);
 	#endif
 
 	return size;
 }
 
+/**
+ * FUNCTION NAME: ENalloc
+ *
+ * DESCRIPTION: Buffer for a payload to pass to ENsend, taken from the pool
+ * 				of the calling worker
+ */
+PooledBuffer EmulNet::ENalloc(size_t size) {
+	return bufferPools[WorkerPool::currentWorker()]->allocate(size);
+}
+
+/**
+ * FUNCTION NAME: ENmaxPayload
+ *
+ * DESCRIPTION: Largest payload ENsend takes
+ */
+size_t EmulNet::ENmaxPayload() {
+	return par->MAX_MSG_SIZE - EN_MSG_HEADER_SIZE - 1;
+}
+
 /**
  * FUNCTION NAME: ENsend
  *
  * DESCRIPTION: EmulNet send function
  *
  * RETURNS:
- * size
+ * same as ENsend above
  */
 int EmulNet::ENsend(Address *myaddr, Address *toaddr, string data) {
-	char * str = (char *) malloc(data.length() * sizeof(char));
-	memcpy(str, data.c_str(), data.size());
-	int ret = this->ENsend(myaddr, toaddr, str, (data.length() * sizeof(char)));
-	free(str);
-	return ret;
+	return this->ENsend(myaddr, toaddr, (char *)data.data(), (data.length() * sizeof(char)));
 }
 
 /**
@@ -141,32 +420,152 @@ int EmulNet::ENsend(Address *myaddr, Address *toaddr, string data) {
  * RETURN:
  * 0
  */
-int EmulNet::ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue){
-	for(int i = emulnet.currbuffsize - 1; i >= 0; i-- ) {
-		en_msg *emsg = emulnet.buff[i];
+int EmulNet::ENrecv(Address *myaddr, int (* enq)(void *, PooledBuffer &&), struct timeval *t, int times, void *queue){
+	auto mailboxPos = emulnet.mailboxes.find(*myaddr);
+	if (mailboxPos == emulnet.mailboxes.end()) {
+		return 0;
+	}
+
+	// Deliver in the order of sending, so FIFO ordering holds on every link.
+	// A sender always uses the lane of its worker and lanes go in worker
+	// order, so the order only depends on the workers count.
+	int dst = *(int *)(myaddr->addr);
+	if( trace && trace->isReplaying() ) {
+		deque<MsgTrace::Record> *records = trace->replayed(traceChannel, dst);
+		while ( records && !records->empty() && records->front().time <= par->getcurrtime() ) {
+			string &data = records->front().payload;
+			PooledBuffer payload = bufferPools[WorkerPool::currentWorker()]->allocate(data.size());
+			memcpy(payload.data(), data.data(), data.size());
+			if ( !(*enq)(queue, move(payload)) ) {
+				break;
+			}
+			msgCounter.countRecv(dst, par->getcurrtime());
+			records->pop_front();
+		}
+		return 0;
+	}
+
+	// Messages the node queue does not take stay in the mailbox, with the
+	// credits of their links, and the node gets woken for them again
+	bool queueFull = false;
+	for (EM::Lane &lane : mailboxPos->second.lanes) {
+		size_t delivered = 0;
+		for (en_msg &emsg : lane.msgs) {
+			// ownership of the payload goes to the node queue, no copy
+			char *data = emsg.payload.data();
+			if ( !(*enq)(queue, move(emsg.payload)) ) {
+				queueFull = true;
+				break;
+			}
+			if( trace && trace->isRecording() ) {
+				trace->record(traceChannel, par->getcurrtime(), *(int *)(emsg.from.addr), dst,
+				              data, emsg.size);
+			}
+			msgCounter.countRecv(dst, par->getcurrtime());
+			delivered++;
+		}
+		emulnet.currbuffsize -= delivered;
+		if ( delivered == lane.msgs.size() ) {
+			// clear() keeps the capacity, so the mailbox is reused on next ticks
+			lane.msgs.clear();
+			// all links to this node have their credits back
+			for (auto &link : lane.inflight) {
+				link.second = 0;
+			}
+		}
+		else {
+			for (size_t i = 0; i < delivered; i++) {
+				lane.inflight[lane.msgs[i].from]--;
+			}
+			lane.msgs.erase(lane.msgs.begin(), lane.msgs.begin() + delivered);
+		}
+		if ( queueFull ) {
+			break;
+		}
+	}
+	if ( queueFull && tracking ) {
+		deliveries[WorkerPool::currentWorker()].push_back(dst);
+	}
 
-		if ( 0 == strcmp(emsg->to.addr, myaddr->addr) ) {
-			// instead of allocing reuse buffer that was going to
-			// be deleted anyway, so simple ...
-			int msize = emsg->size;
-			memmove(emsg, emsg+1, msize);
-			char *msg = (char *)emsg;
-			emulnet.buff[i] = emulnet.buff[emulnet.currbuffsize-1];
-			emulnet.currbuffsize--;
+	return 0;
+}
 
-			(*enq)(queue, msg, msize);
+/**
+ * FUNCTION NAME: ENinflight
+ *
+ * DESCRIPTION: Number of messages sent on the link from myaddr to toaddr
+ * 				that were not yet received
+ */
+int EmulNet::ENinflight(Address *myaddr, Address *toaddr) {
+	auto mailboxPos = emulnet.mailboxes.find(*toaddr);
+	if (mailboxPos == emulnet.mailboxes.end()) {
+		return 0;
+	}
+	EM::Lane &lane = mailboxPos->second.lanes[WorkerPool::currentWorker()];
+	auto linkPos = lane.inflight.find(*myaddr);
+	if (linkPos == lane.inflight.end()) {
+		return 0;
+	}
+	return linkPos->second;
+}
 
-			int dst = *(int *)(myaddr->addr);
-			int time = par->getcurrtime();
+/**
+ * FUNCTION NAME: ENcapacity
+ *
+ * DESCRIPTION: Number of messages the network can still buffer
+ */
+int EmulNet::ENcapacity() {
+	return ENBUFFSIZE - emulnet.currbuffsize;
+}
 
-			assert(dst <= MAX_NODES);
-			assert(time < MAX_TIME);
+/**
+ * FUNCTION NAME: ENtrack
+ *
+ * DESCRIPTION: Turn on recording of the nodes ENwakeups reports
+ */
+void EmulNet::ENtrack(bool enabled) {
+	tracking = enabled;
+}
 
-			recv_msgs[dst][time]++;
-		}
+/**
+ * FUNCTION NAME: ENtrace
+ *
+ * DESCRIPTION: Record deliveries to, or replay them from, msgTrace. Each
+ * 				EmulNet sharing a trace uses its own channel.
+ */
+void EmulNet::ENtrace(MsgTrace *msgTrace, int channel) {
+	trace = msgTrace;
+	traceChannel = channel;
+}
+
+/**
+ * FUNCTION NAME: ENblocked
+ *
+ * DESCRIPTION: Sender could not use a saturated link, it is reported
+ * 				as active so that it gets a chance to retry
+ */
+void EmulNet::ENblocked(Address *myaddr) {
+	int src = *(int *)(myaddr->addr);
+	vector<int> &laneSenders = senders[WorkerPool::currentWorker()];
+	if( tracking && (laneSenders.empty() || laneSenders.back() != src) ) {
+		laneSenders.push_back(src);
 	}
+}
 
-	return 0;
+/**
+ * FUNCTION NAME: ENwakeups
+ *
+ * DESCRIPTION: Appends ids of nodes that got mail to delivered and ids of
+ * 				nodes that sent to active since the last call. Ids may
+ * 				repeat. Must not run concurrently with sends.
+ */
+void EmulNet::ENwakeups(vector<int> &delivered, vector<int> &active) {
+	for ( int lane = 0; lane < lanesCount; lane++ ) {
+		delivered.insert(delivered.end(), deliveries[lane].begin(), deliveries[lane].end());
+		active.insert(active.end(), senders[lane].begin(), senders[lane].end());
+		deliveries[lane].clear();
+		senders[lane].clear();
+	}
 }
 
 /**
@@ -181,27 +580,32 @@ int EmulNet::ENcleanup() {
 
 	FILE* file = fopen("msgcount.log", "w+");
 
-	while(emulnet.currbuffsize > 0) {
-		free(emulnet.buff[--emulnet.currbuffsize]);
+	for (auto &mailbox : emulnet.mailboxes) {
+		for (EM::Lane &lane : mailbox.second.lanes) {
+			lane.msgs.clear();
+			lane.inflight.clear();
+		}
 	}
+	emulnet.currbuffsize = 0;
 
 	for ( i = 1; i <= par->EN_GPSZ; i++ ) {
 		fprintf(file, "node %3d ", i);
 		sent_total = 0;
 		recv_total = 0;
 
-		for (j = 0; j < par->getcurrtime(); j++) {
+		for (j = 0; j < msgCounter.getBucketsCount(par->getcurrtime()); j++) {
+			MsgCounter::Bucket counts = msgCounter.get(i, j);
 
-			sent_total += sent_msgs[i][j];
-			recv_total += recv_msgs[i][j];
+			sent_total += counts.sent;
+			recv_total += counts.recv;
 			if (i != 67) {
-				fprintf(file, " (%4d, %4d)", sent_msgs[i][j], recv_msgs[i][j]);
+				fprintf(file, " (%4d, %4d)", counts.sent, counts.recv);
 				if (j % 10 == 9) {
 					fprintf(file, "\n         ");
 				}
 			}
 			else {
-				fprintf(file, "special %4d %4d %4d\n", j, sent_msgs[i][j], recv_msgs[i][j]);
+				fprintf(file, "special %4d %4d %4d\n", j * msgCounter.getBucketWidth(), counts.sent, counts.recv);
 			}
 		}
 		fprintf(file, "\n");
@@ -211,3 +615,20 @@ int EmulNet::ENcleanup() {
 	fclose(file);
 	return 0;
 }
+
+/**
+ * FUNCTION NAME: getBufferPoolStats
+ *
+ * DESCRIPTION: Hit/miss counters of the message buffer pool
+ */
+BufferPoolStats EmulNet::getBufferPoolStats() {
+	BufferPoolStats total = BufferPoolStats{ 0, 0, 0, 0 };
+	for (auto &pool : bufferPools) {
+		BufferPoolStats poolStats = pool->getStats();
+		total.hits += poolStats.hits;
+		total.misses += poolStats.misses;
+		total.inUse += poolStats.inUse;
+		total.slabs += poolStats.slabs;
+	}
+	return total;
+}
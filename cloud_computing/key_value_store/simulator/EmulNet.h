@@ -7,13 +7,21 @@
 #ifndef _EMULNET_H_
 #define _EMULNET_H_
 
-#define MAX_NODES 1000
-#define MAX_TIME 3600
 #define ENBUFFSIZE 30000
+// Bytes of en_msg header as they would travel on the wire
+#define EN_MSG_HEADER_SIZE (sizeof(int) + 2 * sizeof(Address))
 
 #include "stdincludes.h"
 #include "Params.h"
 #include "Member.h"
+#include "BufferPool.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <unordered_map>
 
 using namespace std;
 
@@ -21,33 +29,43 @@ using namespace std;
  * Struct Name: en_msg
  */
 typedef struct en_msg {
-	// Number of bytes after the class
+	// Number of bytes in the payload
 	int size;
 	// Source node
 	Address from;
 	// Destination node
 	Address to;
+	// Message bytes, owned by the EmulNet buffer pool
+	PooledBuffer payload;
 }en_msg;
 
 /**
  * Class Name: EM
+ *
+ * DESCRIPTION: In-flight messages, kept in one FIFO mailbox per destination
  */
 class EM {
 public:
+	struct Lane {
+		vector<en_msg> msgs;
+		// Messages in flight per source node, reset when the mailbox is drained
+		unordered_map<Address, int> inflight;
+	};
+	// One lane per worker thread, a sender only appends to the lane of its
+	// worker, so parallel senders never share a queue
+	struct Mailbox {
+		vector<Lane> lanes;
+	};
+
 	int nextid;
-	int currbuffsize;
+	atomic<int> currbuffsize;
 	int firsteltindex;
-	en_msg* buff[ENBUFFSIZE];
+	unordered_map<Address, Mailbox> mailboxes;
 	EM() {}
 	EM& operator = (EM &anotherEM) {
 		this->nextid = anotherEM.getNextId();
 		this->currbuffsize = anotherEM.getCurrBuffSize();
 		this->firsteltindex = anotherEM.getFirstEltIndex();
-		int i = this->currbuffsize;
-		while (i > 0) {
-			this->buff[i] = anotherEM.buff[i];
-			i--;
-		}
 		return *this;
 	}
 	int getNextId() {
@@ -71,6 +89,64 @@ public:
 	virtual ~EM() {}
 };
 
+/**
+ * Class Name: MsgCounter
+ *
+ * DESCRIPTION: Sent/received message counts per node and per time bucket.
+ * 				Storage grows on demand, only for nodes that used the network.
+ */
+class MsgCounter {
+public:
+	struct Bucket {
+		int sent;
+		int recv;
+	};
+	MsgCounter(int bucketWidth = 1, int nodesCount = 0);
+	void countSent(int node, int time);
+	void countRecv(int node, int time);
+	Bucket get(int node, int bucket) const;
+	int getBucketWidth() const;
+	int getBucketsCount(int time) const;
+private:
+	Bucket& at(int node, int time);
+	int bucketWidth;
+	vector<vector<Bucket>> nodes;
+};
+
+/**
+ * Class Name: MsgTrace
+ *
+ * DESCRIPTION: Binary trace of every message handed over to a node.
+ * 				Recording appends messages to the file as mailboxes are
+ * 				drained. Replay loads the file up front and hands out the
+ * 				recorded messages, at the recorded times, instead of what
+ * 				the nodes send.
+ */
+class MsgTrace {
+public:
+	struct Record {
+		int time;
+		int from;
+		string payload;
+	};
+	MsgTrace();
+	~MsgTrace();
+	int startRecording(const char *path, unsigned seed);
+	int startReplay(const char *path);
+	bool isRecording() const;
+	bool isReplaying() const;
+	unsigned getSeed() const;
+	void record(int channel, int time, int from, int to, const char *data, int size);
+	deque<Record>* replayed(int channel, int to);
+private:
+	FILE *file;
+	bool replaying;
+	unsigned seed;
+	mutex lock;
+	// Messages to replay, per channel and destination node
+	map<pair<int, int>, deque<Record>> records;
+};
+
 /**
  * CLASS NAME: EmulNet
  *
@@ -80,20 +156,42 @@ class EmulNet
 {
 private:
 	Params* par;
-	int sent_msgs[MAX_NODES + 1][MAX_TIME];
-	int recv_msgs[MAX_NODES + 1][MAX_TIME];
+	MsgCounter msgCounter;
 	int enInited;
+	int lanesCount;
+	// Pool per worker, buffers can be given back from any thread
+	vector<unique_ptr<BufferPool>> bufferPools;
+	// Drop decisions of every source node, seeded from SEED
+	vector<mt19937> dropRngs;
+	// Node ids that got mail and that used the network, per worker
+	bool tracking;
+	vector<vector<int>> deliveries;
+	vector<vector<int>> senders;
+	MsgTrace *trace;
+	int traceChannel;
 	EM emulnet;
+	void initLanes();
+	void copyMessages(EmulNet &anotherEmulNet);
 public:
- 	EmulNet(Params *p);
+ 	EmulNet(Params *p, int msgCountBucketWidth = 1);
  	EmulNet(EmulNet &anotherEmulNet);
  	EmulNet& operator = (EmulNet &anotherEmulNet);
  	virtual ~EmulNet();
 	void *ENinit(Address *myaddr, short port);
 	int ENsend(Address *myaddr, Address *toaddr, string data);
 	int ENsend(Address *myaddr, Address *toaddr, char *data, int size);
-	int ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue);
+	int ENsend(Address *myaddr, Address *toaddr, PooledBuffer &&payload);
+	PooledBuffer ENalloc(size_t size);
+	size_t ENmaxPayload();
+	int ENrecv(Address *myaddr, int (* enq)(void *, PooledBuffer &&), struct timeval *t, int times, void *queue);
+	int ENinflight(Address *myaddr, Address *toaddr);
+	int ENcapacity();
+	void ENtrack(bool enabled);
+	void ENtrace(MsgTrace *msgTrace, int channel);
+	void ENblocked(Address *myaddr);
+	void ENwakeups(vector<int> &delivered, vector<int> &active);
 	int ENcleanup();
+	BufferPoolStats getBufferPoolStats();
 };
 
 #endif /* _EMULNET_H_ */
@@ -0,0 +1,50 @@
+/**********************************
+ * FILE NAME: EventQueue.cpp
+ *
+ * DESCRIPTION: Wakeups of the simulated nodes ordered by time
+ **********************************/
+
+#include "EventQueue.h"
+
+#include <climits>
+
+/**
+ * FUNCTION NAME: schedule
+ *
+ * DESCRIPTION: Wakes node at time
+ */
+void EventQueue::schedule(int time, int node) {
+	wakeups.push(Wakeup(time, node));
+}
+
+/**
+ * FUNCTION NAME: popDue
+ *
+ * DESCRIPTION: Moves nodes due at or before time to dueNodes, ascending and
+ * 				with every node once
+ */
+void EventQueue::popDue(int time, vector<int> &dueNodes) {
+	dueNodes.clear();
+	while ( !wakeups.empty() && wakeups.top().first <= time ) {
+		dueNodes.push_back(wakeups.top().second);
+		wakeups.pop();
+	}
+	sort(dueNodes.begin(), dueNodes.end());
+	dueNodes.erase(unique(dueNodes.begin(), dueNodes.end()), dueNodes.end());
+}
+
+/**
+ * FUNCTION NAME: nextTime
+ *
+ * DESCRIPTION: Earliest wakeup, INT_MAX when nothing is scheduled
+ */
+int EventQueue::nextTime() {
+	if ( wakeups.empty() ) {
+		return INT_MAX;
+	}
+	return wakeups.top().first;
+}
+
+bool EventQueue::empty() {
+	return wakeups.empty();
+}
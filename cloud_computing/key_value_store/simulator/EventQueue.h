@@ -0,0 +1,37 @@
+/**********************************
+ * FILE NAME: EventQueue.h
+ *
+ * DESCRIPTION: Wakeups of the simulated nodes ordered by time
+ **********************************/
+
+#ifndef _EVENTQUEUE_H_
+#define _EVENTQUEUE_H_
+
+#include "stdincludes.h"
+
+#include <functional>
+#include <utility>
+
+/**
+ * CLASS NAME: EventQueue
+ *
+ * DESCRIPTION: Min-heap of (time, node) wakeups. The simulation jumps from
+ * 				one due time to the next and runs only the nodes woken at
+ * 				that time, a node scheduled many times for the same time
+ * 				runs once.
+ */
+class EventQueue {
+private:
+	typedef pair<int, int> Wakeup;
+	priority_queue<Wakeup, vector<Wakeup>, greater<Wakeup> > wakeups;
+public:
+	// Wakes node at time
+	void schedule(int time, int node);
+	// Moves nodes due at or before time to dueNodes, ascending and unique
+	void popDue(int time, vector<int> &dueNodes);
+	// Earliest wakeup, INT_MAX when nothing is scheduled
+	int nextTime();
+	bool empty();
+};
+
+#endif /* _EVENTQUEUE_H_ */
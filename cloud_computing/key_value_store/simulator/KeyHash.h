@@ -0,0 +1,226 @@
+/**********************************
+ * FILE NAME: KeyHash.h
+ *
+ * DESCRIPTION: Stable 64 bit hash of keys, one at a time or in batches
+ **********************************/
+
+#ifndef KEYHASH_H_
+#define KEYHASH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/**
+ * Hash built the way wyhash final4 is: input is read as little endian
+ * words, each pair folded with a 64x64->128 bit multiply. Unlike
+ * std::hash the result is the same for every build, platform and
+ * process, so all nodes place a key on the same ring position.
+ */
+static const uint64_t KEY_HASH_SEED = 0;
+// Keys hashed together by hashKeys()
+static const size_t   KEY_HASH_LANES = 4;
+
+namespace keyhash {
+
+static const uint64_t SECRET[4] = {
+    0xa0761d6478bd642full, 0xe7037ed1a0b428dbull,
+    0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull
+};
+
+// 128 bit product of a and b, low half into a and high half into b
+inline void multiply(uint64_t &a, uint64_t &b) {
+#ifdef __SIZEOF_INT128__
+    auto product = (unsigned __int128)a * b;
+    a = uint64_t(product);
+    b = uint64_t(product >> 64);
+#else
+    static const uint64_t LOW_HALF = 0xffffffffull;
+    uint64_t high    = (a >> 32) * (b >> 32);
+    uint64_t middle0 = (a >> 32) * (b & LOW_HALF);
+    uint64_t middle1 = (a & LOW_HALF) * (b >> 32);
+    uint64_t low     = (a & LOW_HALF) * (b & LOW_HALF);
+    uint64_t carry   = (low >> 32) + (middle0 & LOW_HALF)
+                     + (middle1 & LOW_HALF);
+    a = (carry << 32) | (low & LOW_HALF);
+    b = high + (middle0 >> 32) + (middle1 >> 32) + (carry >> 32);
+#endif
+}
+
+inline uint64_t mix(uint64_t a, uint64_t b) {
+    multiply(a, b);
+    return a ^ b;
+}
+
+inline uint64_t read64(const uint8_t *pos) {
+    uint64_t word;
+    memcpy(&word, pos, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+inline uint64_t read32(const uint8_t *pos) {
+    uint32_t word;
+    memcpy(&word, pos, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap32(word);
+#endif
+    return word;
+}
+
+// Up to 16 bytes become the two words folded by finish()
+inline void readShort(const uint8_t *pos, size_t size, uint64_t &a,
+                      uint64_t &b) {
+    if (size >= 4) {
+        auto step = (size >> 3) << 2;
+        a = (read32(pos) << 32) | read32(pos + step);
+        b = (read32(pos + size - 4) << 32) | read32(pos + size - 4 - step);
+    } else if (size > 0) {
+        a = (uint64_t(pos[0]) << 16) | (uint64_t(pos[size >> 1]) << 8)
+          | pos[size - 1];
+        b = 0;
+    } else {
+        a = 0;
+        b = 0;
+    }
+}
+
+inline uint64_t finish(uint64_t a, uint64_t b, uint64_t seed, size_t size) {
+    a ^= SECRET[1];
+    b ^= seed;
+    multiply(a, b);
+    return mix(a ^ SECRET[0] ^ size, b ^ SECRET[1]);
+}
+
+inline uint64_t start(uint64_t seed) {
+    return seed ^ mix(seed ^ SECRET[0], SECRET[1]);
+}
+
+} // namespace keyhash
+
+inline uint64_t hashKey(const void *data, size_t size,
+                        uint64_t seed = KEY_HASH_SEED) {
+    using namespace keyhash;
+    auto *pos = (const uint8_t *)data;
+    seed = start(seed);
+    uint64_t a, b;
+    if (size <= 16) {
+        readShort(pos, size, a, b);
+        return finish(a, b, seed, size);
+    }
+
+    auto left = size;
+    if (left >= 48) {
+        auto seed1 = seed, seed2 = seed;
+        do {
+            seed  = mix(read64(pos) ^ SECRET[1], read64(pos + 8) ^ seed);
+            seed1 = mix(read64(pos + 16) ^ SECRET[2], read64(pos + 24) ^ seed1);
+            seed2 = mix(read64(pos + 32) ^ SECRET[3], read64(pos + 40) ^ seed2);
+            pos += 48;
+            left -= 48;
+        } while (left >= 48);
+        seed ^= seed1 ^ seed2;
+    }
+    while (left > 16) {
+        seed = mix(read64(pos) ^ SECRET[1], read64(pos + 8) ^ seed);
+        pos += 16;
+        left -= 16;
+    }
+    a = read64(pos + left - 16);
+    b = read64(pos + left - 8);
+    return finish(a, b, seed, size);
+}
+
+inline uint64_t hashKey(const std::string &key,
+                        uint64_t seed = KEY_HASH_SEED) {
+    return hashKey(key.data(), key.size(), seed);
+}
+
+/**
+ * Hashes count keys, keys[i] of sizes[i] bytes, into hashes[i]. Keys of
+ * up to 16 bytes go KEY_HASH_LANES at a time through independent multiply
+ * chains the CPU overlaps. The hash has no vector form, 64x64->128 bit
+ * products have no SIMD instruction on x86 or ARM, so lanes are the
+ * closest fit. Results equal hashKey() of every key.
+ */
+inline void hashKeys(const char *const *keys, const size_t *sizes,
+                     size_t count, uint64_t *hashes,
+                     uint64_t seed = KEY_HASH_SEED) {
+    using namespace keyhash;
+    auto laneSeed = start(seed);
+    auto idx = size_t(0);
+    for (; idx + KEY_HASH_LANES <= count; idx += KEY_HASH_LANES) {
+        auto allShort = true;
+        for (size_t lane = 0; lane < KEY_HASH_LANES; ++lane)
+            allShort &= sizes[idx + lane] <= 16;
+        if (!allShort) {
+            for (size_t lane = 0; lane < KEY_HASH_LANES; ++lane)
+                hashes[idx + lane] = hashKey(keys[idx + lane],
+                                             sizes[idx + lane], seed);
+            continue;
+        }
+
+        uint64_t a[KEY_HASH_LANES], b[KEY_HASH_LANES];
+        for (size_t lane = 0; lane < KEY_HASH_LANES; ++lane) {
+            readShort((const uint8_t *)keys[idx + lane], sizes[idx + lane],
+                      a[lane], b[lane]);
+        }
+        for (size_t lane = 0; lane < KEY_HASH_LANES; ++lane) {
+            hashes[idx + lane] = finish(a[lane], b[lane], laneSeed,
+                                        sizes[idx + lane]);
+        }
+    }
+    for (; idx < count; ++idx)
+        hashes[idx] = hashKey(keys[idx], sizes[idx], seed);
+}
+
+// Keys hashed per block by hashBlocks()
+static const size_t   KEY_HASH_BLOCK = 8 * KEY_HASH_LANES;
+
+/**
+ * Calls onBlock(items, hashes, count) for every block of up to
+ * KEY_HASH_BLOCK items of [first, last), items[i] is an iterator to the
+ * item whose key, taken with keyOf(item), hashed to hashes[i]. Nothing is
+ * allocated, a block is also the unit of batched placement lookups.
+ */
+template <typename Iter, typename KeyOf, typename OnBlock>
+void hashBlocks(Iter first, Iter last, KeyOf keyOf, OnBlock onBlock,
+                uint64_t seed = KEY_HASH_SEED) {
+    const char *keys[KEY_HASH_BLOCK];
+    size_t sizes[KEY_HASH_BLOCK];
+    uint64_t hashes[KEY_HASH_BLOCK];
+    Iter items[KEY_HASH_BLOCK];
+
+    while (first != last) {
+        auto count = size_t(0);
+        for (; count < KEY_HASH_BLOCK && first != last; ++count, ++first) {
+            const std::string &key = keyOf(*first);
+            keys[count] = key.data();
+            sizes[count] = key.size();
+            items[count] = first;
+        }
+        hashKeys(keys, sizes, count, hashes, seed);
+        onBlock((const Iter *)items, (const uint64_t *)hashes, count);
+    }
+}
+
+/**
+ * Calls onHash(item, hash) for every item of [first, last), keys taken
+ * with keyOf(item) are hashed by hashKeys() in blocks, nothing is
+ * allocated
+ */
+template <typename Iter, typename KeyOf, typename OnHash>
+void hashEach(Iter first, Iter last, KeyOf keyOf, OnHash onHash,
+              uint64_t seed = KEY_HASH_SEED) {
+    hashBlocks(first, last, keyOf,
+               [&onHash](const Iter *items, const uint64_t *hashes,
+                         size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            onHash(*items[i], hashes[i]);
+    }, seed);
+}
+
+#endif /* KEYHASH_H_ */
@@ -52,6 +52,7 @@ void Log::LOG(Address *addr, const char * str, ...) {
 	static char stdstring2[100];
 	static char stdstring3[100];
 	static int dbg_opened=0;
+	lock_guard<mutex> guard(lock);
 
 	if(dbg_opened != 639){
 		numwrites=0;
@@ -121,7 +122,7 @@ void Log::LOG(Address *addr, const char * str, ...) {
  * DESCRIPTION: To Log a node add
  */
 void Log::logNodeAdd(Address *thisNode, Address *addedAddr) {
-	static char stdstring[200];
+	char stdstring[200];
 	sprintf(stdstring, "Node %d.%d.%d.%d:%d joined at time %d", addedAddr->addr[0], addedAddr->addr[1], addedAddr->addr[2], addedAddr->addr[3], *(short *)&addedAddr->addr[4], par->getcurrtime());
     LOG(thisNode, stdstring);
 }
@@ -132,7 +133,7 @@ void Log::logNodeAdd(Address *thisNode, Address *addedAddr) {
  * DESCRIPTION: To log a node remove
  */
 void Log::logNodeRemove(Address *thisNode, Address *removedAddr) {
-	static char stdstring[200];
+	char stdstring[200];
 	sprintf(stdstring, "Node %d.%d.%d.%d:%d removed at time %d", removedAddr->addr[0], removedAddr->addr[1], removedAddr->addr[2], removedAddr->addr[3], *(short *)&removedAddr->addr[4], par->getcurrtime());
     LOG(thisNode, stdstring);
 }
@@ -143,7 +144,7 @@ void Log::logNodeRemove(Address *thisNode, Address *removedAddr) {
  * DESCRTION: Call this function after successfully create a key value pair
  */
 void Log::logCreateSuccess(Address * address, bool isCoordinator, int transID, string key, string value){
-	static char stdstring[200];
+	char stdstring[200];
 	string str;
 	if (isCoordinator)
 		str = "coordinator";
@@ -159,7 +160,7 @@ void Log::logCreateSuccess(Address * address, bool isCoordinator, int transID, s
  * DESCRIPTION: Call this function after successfully reading a key
  */
 void Log::logReadSuccess(Address * address, bool isCoordinator, int transID, string key, string value){
-    static char stdstring[200];
+    char stdstring[200];
 	string str;
 	if (isCoordinator)
 		str = "coordinator";
@@ -175,7 +176,7 @@ void Log::logReadSuccess(Address * address, bool isCoordinator, int transID, str
  * DESCRIPTION: Call this function after successfully updating a key
  */
 void Log::logUpdateSuccess(Address * address, bool isCoordinator, int transID, string key, string newValue){
-    static char stdstring[200];
+    char stdstring[200];
 	string str;
 	if (isCoordinator)
 		str = "coordinator";
@@ -191,7 +192,7 @@ void Log::logUpdateSuccess(Address * address, bool isCoordinator, int transID, s
  * DESCRIPTION: Call this function after successfully deleting a key
  */
 void Log::logDeleteSuccess(Address * address, bool isCoordinator, int transID, string key){
-    static char stdstring[200];
+    char stdstring[200];
 	string str;
 	if (isCoordinator)
 		str = "coordinator";
@@ -207,7 +208,7 @@ void Log::logDeleteSuccess(Address * address, bool isCoordinator, int transID, s
  * DESCRIPTION: Call this function if CREATE failed
  */
 void Log::logCreateFail(Address * address, bool isCoordinator, int transID, string key, string value){
-	static char stdstring[200];
+	char stdstring[200];
 	string str;
 	if (isCoordinator)
 		str = "coordinator";
@@ -224,7 +225,7 @@ void Log::logCreateFail(Address * address, bool isCoordinator, int transID, stri
  * DESCRIPTION: Call this function if READ failed
  */
 void Log::logReadFail(Address * address, bool isCoordinator, int transID, string key){
-    static char stdstring[200];
+    char stdstring[200];
 	string str;
 	if (isCoordinator)
 		str = "coordinator";
@@ -240,7 +241,7 @@ void Log::logReadFail(Address * address, bool isCoordinator, int transID, string
  * DESCRIPTION: Call this function if UPDATE failed
  */
 void Log::logUpdateFail(Address * address, bool isCoordinator, int transID, string key, string newValue){
-    static char stdstring[200];
+    char stdstring[200];
 	string str;
 	if (isCoordinator)
 		str = "coordinator";
@@ -256,7 +257,7 @@ void Log::logUpdateFail(Address * address, bool isCoordinator, int transID, stri
  * DESCRIPTION: Call this function if DELETE failed
  */
 void Log::logDeleteFail(Address * address, bool isCoordinator, int transID, string key){
-    static char stdstring[200];
+    char stdstring[200];
 	string str;
 	if (isCoordinator)
 		str = "coordinator";
@@ -11,6 +11,8 @@
 #include "Params.h"
 #include "Member.h"
 
+#include <mutex>
+
 /*
  * Macros
  */
@@ -29,6 +31,8 @@ class Log {
 private:
 	Params *par;
 	bool firstTime;
+	// Nodes may log from several worker threads
+	std::mutex lock;
 public:
 	Log(Params *p);
 	Log(const Log &anotherLog);
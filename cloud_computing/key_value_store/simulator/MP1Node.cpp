@@ -4,6 +4,8 @@
 
 #include "MP1Node.h"
 
+#include <algorithm>
+#include <cerrno>
 #include <cmath>
 #include <numeric>
 
@@ -39,26 +41,32 @@ protected:
 
     virtual ~GossipBase() = default;
 
-    vector<size_t> pickGossipGroup() {
+    // Shuffles members and returns how many of them to gossip to
+    size_t pickGossipGroup() {
         auto membersCount = node->getMembersList().size();
         membersIndices.resize(membersCount);
         iota(membersIndices.begin(), membersIndices.end(), 0);
-        random_shuffle(membersIndices.begin(), membersIndices.end());
+        shuffle(membersIndices.begin(), membersIndices.end(), node->getRandom());
 
         auto gossipRange = (size_t)log(membersCount);
         if (gossipRange < membersCount) ++gossipRange;
         if (gossipRange < membersCount) ++gossipRange;
 
-        return vector<size_t>(membersIndices.begin(),
-                              membersIndices.begin() + gossipRange);
+        return gossipRange;
     }
 
     void sendGossip(const vector<char> &msg) {
-        auto gossipPeers = pickGossipGroup();
-        for (auto peerIndex : gossipPeers) {
+        auto gossipRange = pickGossipGroup();
+        auto sentCount = size_t(0);
+        // Peers whose link is saturated are skipped, the next ones in the
+        // shuffled order take their place
+        for (auto peerIndex : membersIndices) {
+            if (sentCount == gossipRange)
+                break;
             auto &member = node->getMembersList()[peerIndex];
             auto memberAddr = Address(member.id, member.port);
-            node->send(move(memberAddr), (char *)msg.data(), msg.size());
+            if (node->send(move(memberAddr), (char *)msg.data(), msg.size()) != -EAGAIN)
+                ++sentCount;
         }
     }
 };
@@ -130,11 +138,16 @@ public:
  */
 class FailureDetector : public Task {
     MP1Node *node;
-    static const long failTimeout = TFAIL;
-    static const long removeTimeout = TREMOVE;
+    long failTimeout;
+    long removeTimeout;
 
 public:
-    FailureDetector(MP1Node *node) : Task(), node(node) { }
+    // Timeouts count node clock ticks, task rounds unless the clock
+    // follows the global one
+    FailureDetector(MP1Node *node, int roundTicks)
+        : Task(), node(node),
+          failTimeout(TFAIL * roundTicks),
+          removeTimeout(TREMOVE * roundTicks) { }
     virtual ~FailureDetector() = default;
 
     void run() {
@@ -196,15 +209,21 @@ public:
  * is necessary for your logic to work
  */
 MP1Node::MP1Node(shared_ptr<Member> member, Params *params,
-                EmulNet *emul, Log *log, Address address)
-        : memberNode(member), transport(emul, &member->mp1q, address)
+                shared_ptr<net::Transport> transport, Log *log,
+                Address address)
+        : memberNode(member), transport(move(transport)),
+          nextTasksRun(0)
 {
     this->memberNode->addr = move(address);
     // this->emulNet = emul;
     this->log = log;
     this->par = params;
 
-    tasks.push_back(unique_ptr<Task>(new FailureDetector(this)));
+    seed_seq seed { params->SEED, memberNode->addr.getIp() };
+    random.seed(seed);
+
+    auto roundTicks = params->EVENT_DRIVEN ? params->GOSSIP_PERIOD : 1;
+    tasks.push_back(unique_ptr<Task>(new FailureDetector(this, roundTicks)));
     tasks.push_back(unique_ptr<Task>(new GossipDisseminator(this)));
     tasks.push_back(unique_ptr<Task>(new HearbeatService(this)));
 }
@@ -227,6 +246,7 @@ void MP1Node::nodeStart(char *servaddrstr, short servport) {
         logNode("Unable to join self to group. Exiting.");
         exit(1);
     }
+    transport->flush();
 }
 
 /**
@@ -239,6 +259,7 @@ int MP1Node::init() {
     memberNode->heartbeat = 0;
     memberNode->timestamp = 0;
     memberNode->memberList.clear();
+    ++memberNode->membersVersion;
 
     return ESUCCESS;
 }
@@ -287,7 +308,7 @@ int MP1Node::recvLoop() {
     if (memberNode->bFailed)
         return false;
 
-    return transport.drain();
+    return transport->drain();
 }
 
 /**
@@ -298,22 +319,30 @@ void MP1Node::nodeLoop() {
     if (memberNode->bFailed)
         return;
 
+    if (par->EVENT_DRIVEN)
+        followGlobalTime();
+    transport->notifyWritable();
     drainIngressQueue();
 
-    if (!memberNode->inGroup)
-        return;
+    if (memberNode->inGroup && par->getcurrtime() >= nextTasksRun) {
+        runTasks();
+        nextTasksRun = par->getcurrtime() + par->GOSSIP_PERIOD;
+    }
+    // Replies to a join go out even before the node is in the group
+    transport->flush();
+}
 
-    runTasks();
+int MP1Node::getNextTasksRun() {
+    return nextTasksRun;
 }
 
 /**
  * Check messages in the queue and call the respective message handler
  */
 void MP1Node::drainIngressQueue() {
-    while (transport.pollnb()) {
-        auto buf = transport.recieve();
+    while (transport->pollnb()) {
+        auto buf = transport->recieve();
         handleRequest((char *)buf.data, buf.size);
-        free(buf.data);
     }
 }
 
@@ -352,7 +381,8 @@ int MP1Node::handleRequest(char *data, int size) {
  *
  */
 void MP1Node::handleJoinRequest(void *rawReq, size_t size) {
-    static auto buff = vector<char>();
+    // Shared by the nodes of a worker thread
+    static thread_local auto buff = vector<char>();
     auto payloadSize = memberNode->memberList.size() * sizeof(MemberData);
     buff.resize(sizeof(JoinResponse) + payloadSize);
 
@@ -430,6 +460,7 @@ void MP1Node::updateMemberEntry(MemberListEntry entry) {
     } else if (failedPos == failedMembers.end()) {
         activeMembers[hash] = move(entry);
         memberNode->memberList.push_back(move(entry));
+        ++memberNode->membersVersion;
         logNodeAdd(Address(entry.id, entry.port));
     }
 }
@@ -455,12 +486,17 @@ void MP1Node::handleHeartbeat(void *rawReq, size_t size) {
  * Propagate your membership list
  */
 void MP1Node::runTasks() {
-    advanceTimestamp();
+    if (!par->EVENT_DRIVEN)
+        advanceTimestamp();
     advanceHeartbeat();
 
+    // Tasks only ever drop members from the list
+    auto membersCount = memberNode->memberList.size();
     for (auto &task : tasks) {
         task->run();
     }
+    if (memberNode->memberList.size() != membersCount)
+        ++memberNode->membersVersion;
 }
 
 /**
@@ -507,12 +543,25 @@ void MP1Node::advanceTimestamp() {
     ++memberNode->timestamp;
 }
 
+// Node may sleep through many ticks, so its clock follows the global one
+void MP1Node::followGlobalTime() {
+    memberNode->timestamp = par->getcurrtime();
+}
+
 MP1Node::MembersMap& MP1Node::getFailedMembers() {
     return failedMembers;
 }
 
+std::mt19937& MP1Node::getRandom() {
+    return random;
+}
+
+uint64_t MP1Node::getMembersVersion() {
+    return memberNode->membersVersion;
+}
+
 int MP1Node::send(Address addr, char *data, size_t len) {
-        return transport.send(addr, data, len);
+        return transport->send(addr, data, len);
 }
 
 void MP1Node::logNode(const char *fmt, ...) {
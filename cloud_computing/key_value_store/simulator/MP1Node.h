@@ -16,11 +16,12 @@
 
 #include <functional>
 #include <memory>
+#include <random>
 #include <unordered_set>
 #include <unordered_map>
 
-#define TREMOVE 20    // Remove member timeout
-#define TFAIL   5     // Mark member as failed timeout
+#define TREMOVE 20    // Remove member timeout, in gossip periods
+#define TFAIL   5     // Mark member as failed timeout, in gossip periods
 
 /**
  * Message Types
@@ -93,7 +94,8 @@ public:
     using MembersList = decltype( ((Member*)0)->memberList );
     using MembersMap = std::unordered_map<int64_t, MemberListEntry>;
 
-    MP1Node(shared_ptr<Member>, Params *, EmulNet *, Log *, Address);
+    MP1Node(shared_ptr<Member>, Params *, shared_ptr<net::Transport>, Log *,
+            Address);
     virtual ~MP1Node() = default;
 
 // Handlers API
@@ -105,6 +107,8 @@ public:
     MembersList&        getMembersList();
     MembersMap&         getActiveMembers();
     MembersMap&         getFailedMembers();
+    std::mt19937&       getRandom();
+    uint64_t            getMembersVersion();
     int                 send(Address addr, char *data, size_t len);
 
     void logNode(const char *fmt, ...);
@@ -118,6 +122,8 @@ public:
     void    nodeStart(char *servaddrstr, short serverport);
     void    nodeLoop();
     int     recvLoop();
+    // Time membership duties are due next, only meaningful in group
+    int     getNextTasksRun();
 
 private:
     void    drainIngressQueue();
@@ -133,6 +139,7 @@ private:
     void    updateMemberEntry(MemberListEntry entry);
     void    advanceHeartbeat();
     void    advanceTimestamp();
+    void    followGlobalTime();
 
     Address getJoinAddress();
 
@@ -143,10 +150,13 @@ private:
     Log                 *log;
     Params              *par;
     shared_ptr<Member>  memberNode;
-    net::Transport      transport;
+    shared_ptr<net::Transport> transport;
     MembersMap          activeMembers;
     MembersMap          failedMembers;
     TasksList           tasks;
+    int                 nextTasksRun;
+    // Own stream per node, so runs repeat whatever thread runs the node
+    std::mt19937        random;
 };
 
 #endif /* _MP1NODE_H_ */
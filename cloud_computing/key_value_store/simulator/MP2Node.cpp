@@ -12,21 +12,29 @@
 
 class MembershipServiceAdapter : public MembershipServiceIface {
     AddressList addrList;
+    uint64_t    addrListVersion = UINT64_MAX;
 public:
 
     MembershipServiceAdapter(shared_ptr<Member> member) {
         this->member = member;
     }
 
-    // TODO: not efficient!
+    // Rebuilt only when membership changed since the last call
     const AddressList& getMembersList() override {
+        if (addrListVersion == member->membersVersion)
+            return addrList;
         addrList.clear();
-        for (auto member : member->memberList) {
+        for (auto &member : member->memberList) {
             addrList.push_back(Address(member.id, member.port));
         }
+        addrListVersion = member->membersVersion;
         return addrList;
     }
 
+    uint64_t getMembersVersion() override {
+        return member->membersVersion;
+    }
+
     Address getLocalAddress() override {
         return member->addr;
     }
@@ -39,14 +47,25 @@ private:
 /**
  * Constructs default implementation
  */
-DSNode::DSNode(shared_ptr<Member> member, Params*,
-               EmulNet *emulNet, Log *log, Address *local) {
+DSNode::DSNode(shared_ptr<Member> member, Params *par,
+               shared_ptr<net::Transport> transport, Log *log, Address*) {
     this->member = member.get();
-    auto transport = make_shared<net::Transport>(emulNet, &member->mp2q, *local);
-    auto msgQueue = make_shared<proto::dht::MessageQueue>(transport);
+    auto format = par->WIRE_FORMAT == FLAT_WIRE
+                    ? proto::dht::WireFormat::FLAT
+                    : proto::dht::WireFormat::THRIFT_COMPACT;
+    auto msgQueue = make_shared<proto::dht::MessageQueue>(transport, format);
     auto membershipAdapter = make_shared<MembershipServiceAdapter>(member);
+    auto partitionerOptions = PartitionerOptions();
+    if (par->PARTITIONER == JUMP_PARTITIONER)
+        partitionerOptions.kind = PartitionerKind::JUMP;
+    else if (par->PARTITIONER == RENDEZVOUS_PARTITIONER)
+        partitionerOptions.kind = PartitionerKind::RENDEZVOUS;
+    partitionerOptions.tokensPerNode = par->RING_TOKENS;
+    partitionerOptions.weights.insert(par->NODE_WEIGHTS.begin(),
+                                      par->NODE_WEIGHTS.end());
     this->impl = unique_ptr<DistributedHashTableService>(
-        new DistributedHashTableService(membershipAdapter, msgQueue, log));
+        new DistributedHashTableService(membershipAdapter, msgQueue,
+                                        partitionerOptions, log));
 }
 
 
@@ -71,6 +90,14 @@ void DSNode::clientDelete(const string &key) {
     return impl->remove(key);
 }
 
+void DSNode::clientMultiGet(const vector<string> &keys) {
+    return impl->multiGet(keys);
+}
+
+void DSNode::clientMultiPut(KeyValueMap entries) {
+    return impl->multiPut(move(entries));
+}
+
 bool DSNode::recvLoop() {
     return impl->recieveMessages();
 }
@@ -91,6 +118,10 @@ void DSNode::updateRing() {
     impl->updateCluster();
 }
 
+bool DSNode::hasPendingWork() {
+    return impl->hasPendingWork();
+}
+
 Member* DSNode::getMemberNode() {
     return member;
 }
@@ -23,7 +23,8 @@ class Log;
 
 class DSNode {
 public:
-    DSNode(shared_ptr<Member>, Params*, EmulNet*, Log*, Address*);
+    DSNode(shared_ptr<Member>, Params*, shared_ptr<net::Transport>, Log*,
+           Address*);
     DSNode()        = delete;
     DSNode(DSNode&) = delete;
     virtual ~DSNode();
@@ -33,12 +34,15 @@ public:
     void        clientRead  (const string &key);
     void        clientUpdate(string key, string value);
     void        clientDelete(const string &key);
+    void        clientMultiGet(const vector<string> &keys);
+    void        clientMultiPut(KeyValueMap entries);
 
     // Emulnet and Appliction API
     bool        recvLoop();
     void        checkMessages();
     NodeList    findNodes(const string &key);
     void        updateRing();
+    bool        hasPendingWork();
     Member*     getMemberNode();
 
 private:
@@ -8,20 +8,28 @@
 #define MEMBER_H_
 
 #include "stdincludes.h"
+#include "BufferPool.h"
+#include "SpscRing.h"
 #include "net/Address.h"
 #include <arpa/inet.h>
 /**
  * CLASS NAME: q_elt
  *
- * DESCRIPTION: Entry in the queue
+ * DESCRIPTION: Entry in the queue, owns the message buffer
  */
 class q_elt {
 public:
-	void *elt;
-	int size;
-	q_elt(void *elt, int size);
+	PooledBuffer buffer;
+	q_elt() = default;
+	q_elt(PooledBuffer &&buffer);
 };
 
+// Messages a node has received and not yet handled. The transport of the
+// node fills it and the node drains it, once full the transport leaves
+// further messages in the network.
+using Inbox = SpscRing<q_elt>;
+static const size_t INBOX_CAPACITY = 1024;
+
 
 struct MemberListEntry {
 	int32_t id;
@@ -53,13 +61,15 @@ public:
 	int timestamp      = 0;
 	// Membership table
 	MemberList memberList;
+	// Bumped whenever entries join or leave memberList
+	uint64_t membersVersion = 0;
 	// vector<MemberListEntry> memberList;
 	// My position in the membership table
 	//vector<MemberListEntry>::iterator myPos;
 	// Queue for failure detection messages
-	queue<q_elt> mp1q;
+	Inbox mp1q{INBOX_CAPACITY};
 	// Queue for KVstore messages
-	queue<q_elt> mp2q;
+	Inbox mp2q{INBOX_CAPACITY};
 
 	Member()                                       = default;
 	Member(const Member &)                         = default;
@@ -5,6 +5,7 @@
  **********************************/
 
 #include "Node.h"
+#include "KeyHash.h"
 
 /**
  * constructor
@@ -30,7 +31,8 @@ Node::~Node() {}
  * DESCRIPTION: This function computes the hash code of the node address
  */
 void Node::computeHashCode() {
-	nodeHashCode = hashFunc(nodeAddress.addr)%RING_SIZE;
+	// All address bytes, the id may hold zero bytes a C string stops at
+	nodeHashCode = hashKey(nodeAddress.addr, sizeof(nodeAddress.addr))%RING_SIZE;
 }
 
 /**
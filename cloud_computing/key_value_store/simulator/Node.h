@@ -14,7 +14,6 @@ class Node {
 public:
 	Address nodeAddress;
 	size_t nodeHashCode;
-	std::hash<string> hashFunc;
 	Node();
 	Node(Address address);
 	Node(const Node& another);
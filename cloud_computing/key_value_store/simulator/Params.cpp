@@ -9,7 +9,9 @@
 /**
  * Constructor
  */
-Params::Params(): PORTNUM(8001) {}
+Params::Params(): PORTNUM(8001), TRANSPORT(EMULNET_TRANSPORT), UDP_BASE_PORT(20000),
+	THREADS(1), GOSSIP_PERIOD(1), EVENT_DRIVEN(0), COALESCE(0), SEND_WINDOW(64), MULTI_PUT(0), WIRE_FORMAT(THRIFT_WIRE), PARTITIONER(RING_PARTITIONER), RING_TOKENS(256),
+	SEED(time(NULL)) {}
 
 /**
  * FUNCTION NAME: setparams
@@ -19,6 +21,7 @@ Params::Params(): PORTNUM(8001) {}
 void Params::setparams(char *config_file) {
 	//trace.funcEntry("Params::setparams");
 	char CRUD[10];
+	char key[32], value[256];
 	FILE *fp = fopen(config_file,"r");
 
 	fscanf(fp,"MAX_NNB: %d", &MAX_NNB);
@@ -27,6 +30,80 @@ void Params::setparams(char *config_file) {
 	fscanf(fp,"\nMSG_DROP_PROB: %lf", &MSG_DROP_PROB);
 	fscanf(fp,"\nCRUD_TEST: %s", CRUD);
 
+	// Optional entries in any order, nodes talk over EmulNet unless asked
+	// otherwise. Same SEED and THREADS give the same run.
+	while ( fscanf(fp, " %31[^:]: %255s", key, value) == 2 ) {
+		if ( 0 == strcmp(key, "TRANSPORT") ) {
+			if ( 0 == strcmp(value, "UDP") ) {
+				this->TRANSPORT = UDP_TRANSPORT;
+			}
+			else if ( 0 == strcmp(value, "URING") ) {
+				this->TRANSPORT = URING_TRANSPORT;
+			}
+			else if ( 0 == strcmp(value, "SHM") ) {
+				this->TRANSPORT = SHM_TRANSPORT;
+			}
+		}
+		else if ( 0 == strcmp(key, "UDP_BASE_PORT") ) {
+			UDP_BASE_PORT = atoi(value);
+		}
+		else if ( 0 == strcmp(key, "THREADS") ) {
+			THREADS = atoi(value);
+		}
+		else if ( 0 == strcmp(key, "GOSSIP_PERIOD") ) {
+			GOSSIP_PERIOD = atoi(value);
+		}
+		else if ( 0 == strcmp(key, "EVENT_DRIVEN") ) {
+			EVENT_DRIVEN = atoi(value);
+		}
+		else if ( 0 == strcmp(key, "WIRE_FORMAT") ) {
+			if ( 0 == strcmp(value, "FLAT") ) {
+				WIRE_FORMAT = FLAT_WIRE;
+			}
+		}
+		else if ( 0 == strcmp(key, "COALESCE") ) {
+			COALESCE = atoi(value);
+		}
+		else if ( 0 == strcmp(key, "SEND_WINDOW") ) {
+			SEND_WINDOW = atoi(value);
+		}
+		else if ( 0 == strcmp(key, "MULTI_PUT") ) {
+			MULTI_PUT = atoi(value);
+		}
+		else if ( 0 == strcmp(key, "PARTITIONER") ) {
+			if ( 0 == strcmp(value, "JUMP") ) {
+				PARTITIONER = JUMP_PARTITIONER;
+			}
+			else if ( 0 == strcmp(value, "RENDEZVOUS") ) {
+				PARTITIONER = RENDEZVOUS_PARTITIONER;
+			}
+		}
+		else if ( 0 == strcmp(key, "RING_TOKENS") ) {
+			RING_TOKENS = atoi(value);
+		}
+		else if ( 0 == strcmp(key, "NODE_WEIGHTS") ) {
+			// id=weight pairs separated by commas, e.g. 1=2,5=0.5
+			int id;
+			double weight;
+			int consumed;
+			for ( char *pair = value; sscanf(pair, "%d=%lf%n", &id, &weight, &consumed) == 2; pair += consumed ) {
+				NODE_WEIGHTS[id] = weight;
+				if ( pair[consumed] == ',' ) {
+					consumed++;
+				}
+			}
+		}
+		else if ( 0 == strcmp(key, "SEED") ) {
+			SEED = (unsigned)strtoul(value, NULL, 10);
+		}
+		else if ( 0 == strcmp(key, "TRACE_RECORD") ) {
+			TRACE_RECORD = value;
+		}
+		else if ( 0 == strcmp(key, "TRACE_REPLAY") ) {
+			TRACE_REPLAY = value;
+		}
+	}
+
 	if ( 0 == strcmp(CRUD, "CREATE") ) {
 		this->CRUDTEST = CREATE_TEST;
 	}
@@ -42,7 +119,31 @@ void Params::setparams(char *config_file) {
 
 	//printf("Parameters of the test case: %d %d %d %lf\n", MAX_NNB, SINGLE_FAILURE, DROP_MSG, MSG_DROP_PROB);
 
+	if ( THREADS < 1 ) {
+		THREADS = 1;
+	}
+	if ( GOSSIP_PERIOD < 1 ) {
+		GOSSIP_PERIOD = 1;
+	}
+	if ( SEND_WINDOW < 1 ) {
+		SEND_WINDOW = 1;
+	}
+	if ( RING_TOKENS < 1 ) {
+		RING_TOKENS = 1;
+	}
+
 	EN_GPSZ = MAX_NNB;
+
+	// MP1 sockets take UDP_BASE_PORT + 1..EN_GPSZ and MP2 ones the range
+	// after it, a port past 65535 would wrap onto another node or below
+	// the unprivileged ports
+	if ( TRANSPORT == UDP_TRANSPORT || TRANSPORT == URING_TRANSPORT ) {
+		if ( UDP_BASE_PORT < 1024 || UDP_BASE_PORT + 2 * EN_GPSZ + 1 > 65535 ) {
+			fprintf(stderr, "UDP_BASE_PORT %d with %d nodes needs ports %d..%d, outside 1024..65535\n",
+					UDP_BASE_PORT, EN_GPSZ, UDP_BASE_PORT + 1, UDP_BASE_PORT + 2 * EN_GPSZ + 1);
+			exit(1);
+		}
+	}
 	STEP_RATE=.25;
 	MAX_MSG_SIZE = 4000;
 	globaltime = 0;
@@ -12,6 +12,9 @@
 #include "Member.h"
 
 enum testTYPE { CREATE_TEST, READ_TEST, UPDATE_TEST, DELETE_TEST };
+enum transportTYPE { EMULNET_TRANSPORT, UDP_TRANSPORT, URING_TRANSPORT, SHM_TRANSPORT };
+enum wireFORMAT { THRIFT_WIRE, FLAT_WIRE };
+enum partitionerTYPE { RING_PARTITIONER, JUMP_PARTITIONER, RENDEZVOUS_PARTITIONER };
 
 /**
  * CLASS NAME: Params
@@ -32,6 +35,21 @@ public:
 	int allNodesJoined;
 	short PORTNUM;
 	int CRUDTEST;
+	int TRANSPORT;				// network backing the nodes
+	int UDP_BASE_PORT;			// node N listens on UDP_BASE_PORT + N
+	int THREADS;				// workers running the nodes
+	int GOSSIP_PERIOD;			// ticks between membership gossip rounds
+	int EVENT_DRIVEN;			// run only nodes with something due, skipping idle ticks
+	int COALESCE;				// envelope size in bytes, 0 sends every message alone
+	int SEND_WINDOW;			// messages in flight per link before sends block
+	int MULTI_PUT;				// insert test pairs with a single MULTI_PUT
+	int WIRE_FORMAT;			// encoding of KV store messages
+	int PARTITIONER;			// placement of keys on nodes
+	int RING_TOKENS;			// ring tokens of a node of weight 1
+	map<int, double> NODE_WEIGHTS;	// key share weight by node id, 1 when not listed
+	unsigned SEED;				// seed of every random choice
+	string TRACE_RECORD;		// file to record EmulNet deliveries to
+	string TRACE_REPLAY;		// file to replay EmulNet deliveries from
 	Params();
 	void setparams(char *);
 	int getcurrtime();
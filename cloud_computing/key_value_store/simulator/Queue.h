@@ -1,7 +1,7 @@
 /**********************************
  * FILE NAME: Queue.h
  *
- * DESCRIPTION: Header file for std::<queue> related functions
+ * DESCRIPTION: Header file for node inbox related functions
  **********************************/
 
 #ifndef QUEUE_H_
@@ -13,16 +13,15 @@
 /**
  * Class name: Queue
  *
- * Description: This function wraps std::queue related functions
+ * Description: This function wraps node inbox related functions
  */
 class Queue {
 public:
 	Queue() {}
 	virtual ~Queue() {}
-	static bool enqueue(queue<q_elt> *queue, void *buffer, int size) {
-		q_elt element(buffer, size);
-		queue->emplace(element);
-		return true;
+	// False when the inbox is full, buffer stays with the caller then
+	static bool enqueue(Inbox *inbox, PooledBuffer &&buffer) {
+		return inbox->emplace(move(buffer));
 	}
 };
 
@@ -0,0 +1,118 @@
+/**********************************
+ * FILE NAME: SpscRing.h
+ *
+ * DESCRIPTION: Bounded single producer, single consumer ring
+ **********************************/
+
+#ifndef SPSCRING_H_
+#define SPSCRING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * CLASS NAME: SpscRing
+ *
+ * DESCRIPTION: Fixed array of slots indexed by free running head and tail
+ *              counters, each padded off the cache lines of anything else.
+ *              Padding rather than alignas keeps the ring an ordinary type
+ *              that new and make_shared place correctly. Only the producer moves
+ *              tail and only the consumer moves head, so emplace and pop need
+ *              no locks and may run on different threads at the same time.
+ *              Each side keeps a copy of the other counter and reloads it
+ *              only when the ring looks full or empty. Interface follows
+ *              std::queue, emplace() refuses items once the ring is full.
+ */
+template <typename T>
+class SpscRing {
+public:
+    // Capacity is rounded up to a power of two
+    explicit SpscRing(size_t capacity) {
+        auto slotsCount = size_t(1);
+        while (slotsCount < capacity)
+            slotsCount <<= 1;
+        slots.resize(slotsCount);
+        mask = slotsCount - 1;
+        consumer.counter = 0;
+        consumer.cachedOther = 0;
+        producer.counter = 0;
+        producer.cachedOther = 0;
+    }
+    SpscRing(const SpscRing&)            = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    /*
+     * Producer side
+     */
+    // Builds the item in the tail slot, returns false and leaves the
+    // arguments untouched when the ring is full
+    template <typename... Args>
+    bool emplace(Args&&... args) {
+        auto pos = producer.counter.load(std::memory_order_relaxed);
+        if (pos - producer.cachedOther > mask) {
+            producer.cachedOther
+                = consumer.counter.load(std::memory_order_acquire);
+            if (pos - producer.cachedOther > mask)
+                return false;
+        }
+        slots[pos & mask] = T(std::forward<Args>(args)...);
+        producer.counter.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Slots emplace() is sure to find free, the consumer may free more
+    size_t freeSlots() {
+        producer.cachedOther = consumer.counter.load(std::memory_order_acquire);
+        return slots.size() - (producer.counter.load(std::memory_order_relaxed)
+                               - producer.cachedOther);
+    }
+
+    /*
+     * Consumer side
+     */
+    bool empty() {
+        auto pos = consumer.counter.load(std::memory_order_relaxed);
+        if (pos == consumer.cachedOther)
+            consumer.cachedOther
+                = producer.counter.load(std::memory_order_acquire);
+        return pos == consumer.cachedOther;
+    }
+
+    // Oldest item, the ring must not be empty
+    T& front() {
+        return slots[consumer.counter.load(std::memory_order_relaxed) & mask];
+    }
+
+    // Drops the oldest item, its slot is reset so it lets go of resources
+    void pop() {
+        auto pos = consumer.counter.load(std::memory_order_relaxed);
+        slots[pos & mask] = T();
+        consumer.counter.store(pos + 1, std::memory_order_release);
+    }
+
+    size_t capacity() const {
+        return slots.size();
+    }
+
+private:
+    static const size_t CACHE_LINE_SIZE = 64;
+
+    // Counter one side moves and its copy of the other side's counter. A
+    // whole line of padding on both ends keeps them off any line shared
+    // with the other side or the neighbours of the ring.
+    struct Side {
+        char                padBefore[CACHE_LINE_SIZE];
+        std::atomic<size_t> counter;
+        size_t              cachedOther;
+        char                padAfter[CACHE_LINE_SIZE];
+    };
+
+    std::vector<T>  slots;
+    size_t          mask;
+    Side            consumer;       // counter is head, cachedOther tail
+    Side            producer;       // counter is tail, cachedOther head
+};
+
+#endif /* SPSCRING_H_ */
@@ -0,0 +1,116 @@
+/**********************************
+ * FILE NAME: WorkerPool.cpp
+ *
+ * DESCRIPTION: Threads running simulation phases over the nodes
+ **********************************/
+
+#include "WorkerPool.h"
+
+static thread_local int currentWorkerId = 0;
+
+/**
+ * Constructor
+ */
+WorkerPool::WorkerPool(int workersCount): phase(0), pendingWorkers(0), stopping(false), task(NULL), nodesCount(0) {
+	for ( int worker = 1; worker < workersCount; worker++ ) {
+		threads.push_back(thread(&WorkerPool::workerLoop, this, worker));
+	}
+}
+
+/**
+ * Destructor
+ */
+WorkerPool::~WorkerPool() {
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	phaseStarted.notify_all();
+	for ( unsigned int i = 0; i < threads.size(); i++ ) {
+		threads[i].join();
+	}
+}
+
+int WorkerPool::getWorkersCount() {
+	return threads.size() + 1;
+}
+
+int WorkerPool::currentWorker() {
+	return currentWorkerId;
+}
+
+/**
+ * FUNCTION NAME: forEachNode
+ *
+ * DESCRIPTION: Runs task for every node on the workers and waits for all
+ * 				of them, the next phase sees everything this one did
+ */
+void WorkerPool::forEachNode(int nodesCount, const NodeTask &task) {
+	if ( threads.empty() ) {
+		this->task = &task;
+		this->nodesCount = nodesCount;
+		runChunk(0);
+		return;
+	}
+
+	{
+		lock_guard<mutex> guard(lock);
+		this->task = &task;
+		this->nodesCount = nodesCount;
+		pendingWorkers = threads.size();
+		phase++;
+	}
+	phaseStarted.notify_all();
+	runChunk(0);
+
+	unique_lock<mutex> guard(lock);
+	while ( pendingWorkers != 0 ) {
+		phaseDone.wait(guard);
+	}
+}
+
+/**
+ * FUNCTION NAME: workerLoop
+ *
+ * DESCRIPTION: Body of a worker thread, runs its chunk of every phase
+ */
+void WorkerPool::workerLoop(int worker) {
+	currentWorkerId = worker;
+	uint64_t seenPhase = 0;
+	while ( true ) {
+		{
+			unique_lock<mutex> guard(lock);
+			while ( !stopping && phase == seenPhase ) {
+				phaseStarted.wait(guard);
+			}
+			if ( stopping ) {
+				return;
+			}
+			seenPhase = phase;
+		}
+
+		runChunk(worker);
+
+		lock_guard<mutex> guard(lock);
+		if ( --pendingWorkers == 0 ) {
+			phaseDone.notify_one();
+		}
+	}
+}
+
+/**
+ * FUNCTION NAME: runChunk
+ *
+ * DESCRIPTION: Worker 0 takes the highest nodes, so walking the workers in
+ * 				order visits nodes from the highest down, whatever the
+ * 				workers count is
+ */
+void WorkerPool::runChunk(int worker) {
+	int workersCount = getWorkersCount();
+	int chunk = (nodesCount + workersCount - 1) / workersCount;
+	int high = nodesCount - worker * chunk;
+	int low = max(0, high - chunk);
+	for ( int node = high - 1; node >= low; node-- ) {
+		(*task)(node);
+	}
+}
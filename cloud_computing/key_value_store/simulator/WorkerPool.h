@@ -0,0 +1,56 @@
+/**********************************
+ * FILE NAME: WorkerPool.h
+ *
+ * DESCRIPTION: Threads running simulation phases over the nodes
+ **********************************/
+
+#ifndef _WORKERPOOL_H_
+#define _WORKERPOOL_H_
+
+#include "stdincludes.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/**
+ * CLASS NAME: WorkerPool
+ *
+ * DESCRIPTION: Splits nodes in static chunks, one per worker, and runs a
+ * 				phase over all of them. Calling thread is worker 0, so with
+ * 				a single worker everything stays on the calling thread.
+ * 				A node is always handled by the same worker, which keeps
+ * 				per node state single threaded.
+ */
+class WorkerPool {
+private:
+	vector<thread> threads;
+	mutex lock;
+	condition_variable phaseStarted;
+	condition_variable phaseDone;
+	uint64_t phase;
+	int pendingWorkers;
+	bool stopping;
+	const function<void(int node)> *task;
+	int nodesCount;
+
+	void workerLoop(int worker);
+	void runChunk(int worker);
+public:
+	typedef function<void(int node)> NodeTask;
+
+	WorkerPool(int workersCount);
+	WorkerPool(const WorkerPool &) = delete;
+	WorkerPool& operator = (const WorkerPool &) = delete;
+	~WorkerPool();
+	// Runs task for every node in [0, nodesCount) and waits for all of
+	// them, each worker walks its chunk from the highest node down
+	void forEachNode(int nodesCount, const NodeTask &task);
+	int getWorkersCount();
+	// Worker the calling thread belongs to, 0 outside of the pool
+	static int currentWorker();
+};
+
+#endif /* _WORKERPOOL_H_ */